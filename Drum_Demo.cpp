@@ -1,4 +1,8 @@
 
+#include <cfloat>
+#include <cstdio>
+#include <thread>
+
 #include "Gamma/Analysis.h"
 #include "Gamma/Effects.h"
 #include "Gamma/Envelope.h"
@@ -6,7 +10,6 @@
 #include "Gamma/Oscillator.h"
 #include "Gamma/Spatial.h"
 #include "Gamma/Types.h"
-#include "Gamma/SamplePlayer.h"
 
 #include "al/app/al_App.hpp"
 #include "al/graphics/al_Shapes.hpp"
@@ -15,161 +18,26 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "audio_engine/offline.h"
+#include "audio_engine/profiler.h"
+#include "audio_engine/rtguard.h"
+#include "audio_engine/stream.h"
+
+#include "drum_kit.h"
+
 // using namespace gam;
 using namespace al;
 using namespace std;
 
-class Kick : public SynthVoice {
- public:
-  // Unit generators
-  gam::Pan<> mPan;
-  gam::Sine<> mOsc;
-  gam::Decay<> mDecay; // Added decay envelope for pitch
-  gam::AD<> mAmpEnv; // Changed amp envelope from Env<3> to AD<>
-
-  void init() override {
-    // Intialize amplitude envelope
-    // - Minimum attack (to make it thump)
-    // - Short decay
-    // - Maximum amplitude
-    mAmpEnv.attack(0.01);
-    mAmpEnv.decay(0.3);
-    mAmpEnv.amp(1.0);
-
-    // Initialize pitch decay 
-    mDecay.decay(0.3);
-
-    createInternalTriggerParameter("amplitude", 0.3, 0.0, 1.0);
-    createInternalTriggerParameter("frequency", 60, 20, 5000);
-  }
-
-  // The audio processing function
-  void onProcess(AudioIOData& io) override {
-    mOsc.freq(getInternalParameterValue("frequency"));
-    mPan.pos(0);
-    // (removed parameter control for attack and release)
-
-    while (io()) {
-      mOsc.freqMul(mDecay()); // Multiply pitch oscillator by next decay value
-      float s1 = mOsc() *  mAmpEnv() * getInternalParameterValue("amplitude");
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
-
-    if (mAmpEnv.done()) free();
-  }
-
-  void onTriggerOn() override { mAmpEnv.reset(); mDecay.reset(); }
-
-  void onTriggerOff() override { mAmpEnv.release(); mDecay.finish(); }
-};
-
-/* ---------------------------------------------------------------- */
-
-class Hihat : public SynthVoice {
- public:
-  // Unit generators
-  gam::Pan<> mPan;
-  gam::AD<> mAmpEnv; // Changed amp envelope from Env<3> to AD<>
-  
-  gam::Burst mBurst; // Resonant noise with exponential decay
-
-  void init() override {
-    // Initialize burst - Main freq, filter freq, duration
-    mBurst = gam::Burst(20000, 15000, 0.05);
-
-  }
-
-  // The audio processing function
-  void onProcess(AudioIOData& io) override {
-    while (io()) {
-      float s1 = mBurst();
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
-    // Left this in because I'm not sure how to tell when a burst is done
-    if (mAmpEnv.done()) free();
-  }
-  void onTriggerOn() override { mBurst.reset(); }
-  //void onTriggerOff() override {  }
-};
-
-/* ---------------------------------------------------------------- */
-
-class Snare : public SynthVoice {
- public:
-  // Unit generators
-  gam::Pan<> mPan;
-  gam::AD<> mAmpEnv; // Amplitude envelope
-  gam::Sine<> mOsc; // Main pitch osc (top of drum)
-  gam::Sine<> mOsc2; // Secondary pitch osc (bottom of drum)
-  gam::Decay<> mDecay; // Pitch decay for oscillators
-  gam::ReverbMS<> reverb;	// Schroeder reverberator
-  gam::Burst mBurst; // Noise to simulate rattle/chains
-
-
-  void init() override {
-    // Initialize burst 
-    mBurst = gam::Burst(10000, 5000, 0.3);
-
-    // Initialize amplitude envelope
-    mAmpEnv.attack(0.01);
-    mAmpEnv.decay(0.01);
-    mAmpEnv.amp(1.0);
-
-    // Initialize pitch decay 
-    mDecay.decay(0.8);
-
-    reverb.resize(gam::FREEVERB);
-		reverb.decay(0.5); // Set decay length, in seconds
-		reverb.damping(0.2); // Set high-frequency damping factor in [0, 1]
-
-  }
-
-  // The audio processing function
-  void onProcess(AudioIOData& io) override {
-    mOsc.freq(200);
-    mOsc2.freq(150);
-
-    while (io()) {
-      
-      // Each mDecay() call moves it forward (I think), so we only want
-      // to call it once per sample
-      float decay = mDecay();
-      mOsc.freqMul(decay);
-      mOsc2.freqMul(decay);
-
-      float amp = mAmpEnv();
-      float s1 = mBurst() + (mOsc() * amp * 0.1)+ (mOsc2() * amp * 0.05);
-      s1 += reverb(s1) * 0.2;
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
-    
-    if (mAmpEnv.done()) free();
-  }
-  void onTriggerOn() override { mBurst.reset(); mAmpEnv.reset(); mDecay.reset();}
-  
-  void onTriggerOff() override { mAmpEnv.release(); mDecay.finish(); }
-};
-
 /* ---------------------------------------------------------------- */
 
 class MyApp : public App {
  public:
-  SynthGUIManager<Kick> synthManager{"Kick"};
-
   // Set to 'true' if using samples
   bool hasSample = false; 
 
-  // Added SamplePlayer to mix in external audio clips
-  gam::SamplePlayer<> samplePlayer;
+  // External audio clip, streamed from disk by a reader thread
+  engine::SampleStream samplePlayer;
   bool paused = true;
 
   ParameterMIDI parameterMIDI;
@@ -177,9 +45,21 @@ class MyApp : public App {
 
   gam::Burst mBurst();
 
+  // Pools, grooves, snare reverb and the mixer, everything onSound() plays
+  DrumKit kit;
+
+  // The clip's mixer source, after the kit's drums and reverb return
+  int sampleBus = kit.mixer.add(1, 0, false);
+
+  // onSound() timing against the block deadline, stages in onSound() order
+  engine::BlockProfiler profiler;
+  enum { STAGE_RENDER, STAGE_MIX };
+
   void onInit() override {
     // Set sampling rate for Gamma objects from app's audio
     gam::sampleRate(audioIO().framesPerSecond());
+    kit.init(audioIO().framesPerSecond(), audioIO().framesPerBuffer());
+    profiler.deadline(audioIO().framesPerBuffer(), audioIO().framesPerSecond());
   }
 
   void onCreate() override {
@@ -188,180 +68,214 @@ class MyApp : public App {
     navControl().active(false);  // Disable navigation via keyboard, since we
                                  // will be using keyboard for note triggering
 
-    // Play example sequence. Comment this line to start from scratch
-    //    synthManager.synthSequencer().playSequence("synth4.synthSequence");
-    synthManager.synthRecorder().verbose(true);
-
-    // Load audio sample (files go in bin folder)
-    if(hasSample) samplePlayer.load("guitartest.wav");
+    // Open audio sample (files go in bin folder), only the header is read here
+    if(hasSample) hasSample = samplePlayer.open("guitartest.wav", 2.0, audioIO().framesPerSecond());
 
   }
 
   void onSound(AudioIOData& io) override {
-    synthManager.render(io);  // Render audio
-    
-    // After rendering synths, 
-    while(io() && !paused && hasSample){  
-      float s = samplePlayer();
-      io.out(0) +=  s;
-      io.out(1) += s;
-	  }
+    engine::RtScope rt; // flags allocations and locks in -DENGINE_RT_GUARD builds
+    profiler.beginBlock();
+    kit.render(io);
+    profiler.endStage(STAGE_RENDER);
+
+    kit.renderReverb(io.framesPerBuffer());
+    mix(io);
+    profiler.endStage(STAGE_MIX);
+    profiler.endBlock(kit.voices.active());
+  }
+
+  // The end of onSound(): sums the kit's buses and the clip into io, also
+  // the mix of an exportSession()
+  void mix(AudioIOData& io) {
+    int frames = io.framesPerBuffer();
+
+    // The clip only plays once started, checked once per block
+    kit.mixer.enable(sampleBus, !paused && hasSample);
+    if (kit.mixer.enabled(sampleBus))
+      samplePlayer.read(kit.mixer.left(sampleBus), kit.mixer.right(sampleBus), frames);
+
+    kit.mixer.mix(io.outBuffer(0), io.outBuffer(1), frames);
   }
 
   void onAnimate(double dt) override {
     imguiBeginFrame();
-    synthManager.drawSynthControlPanel();
+    ImGui::Text("Voices: %d active, %d peak", kit.voices.active(), kit.voices.peak());
+    ImGui::Text("Kick pool: %d/%d high water, %ld steals, %ld drops",
+                kit.kicks.highWater(), kit.kicks.capacity(), kit.kicks.steals(), kit.kicks.drops());
+    ImGui::Text("Hihat pool: %d/%d high water, %ld steals, %ld drops",
+                kit.hihats.highWater(), kit.hihats.capacity(), kit.hihats.steals(), kit.hihats.drops());
+    ImGui::Text("Snare pool: %d/%d high water, %ld steals, %ld drops",
+                kit.snares.highWater(), kit.snares.capacity(), kit.snares.steals(), kit.snares.drops());
+    ImGui::Text("Player: %ld request overflows, %ld note off overflows",
+                kit.player.requestOverflows(), kit.player.noteOverflows());
+    drawMixerSource("Kick", kit.drumBus[KICK]);
+    drawMixerSource("Hihat", kit.drumBus[HIHAT]);
+    drawMixerSource("Snare", kit.drumBus[SNARE]);
+    drawMixerSource("Reverb", kit.reverbBus);
+    drawMixerSource("Sample", sampleBus);
+    ImGui::Text("Sample: %ld underruns, %ld frames of silence",
+                samplePlayer.underruns(), samplePlayer.underrunFrames());
+    drawProfile();
     imguiEndFrame();
   }
 
+  // Block time histogram and deadline misses of onSound()
+  void drawProfile() {
+    engine::profile_snapshot p = profiler.snapshot();
+    ImGui::Text("Audio: %.2f ms last, %.2f p99, %.2f max of %.2f ms, %ld/%ld blocks late",
+                p.lastNs * 1e-6, p.percentile(0.99) * 1e-6, p.maxNs * 1e-6, p.deadlineNs * 1e-6,
+                p.misses, p.blocks);
+    ImGui::Text("Render %.2f ms (max %.2f), mix %.2f ms (max %.2f), %d voices (max %d)",
+                p.stageLastNs[STAGE_RENDER] * 1e-6, p.stageMaxNs[STAGE_RENDER] * 1e-6,
+                p.stageLastNs[STAGE_MIX] * 1e-6, p.stageMaxNs[STAGE_MIX] * 1e-6,
+                p.voices, p.maxVoices);
+    ImGui::PlotHistogram("Block time (log, up to 2 deadlines)", p.histogram, p.buckets, 0, nullptr,
+                         0, FLT_MAX, ImVec2(0, 60));
+  }
+
+  // Gain and pan sliders for one mixer source
+  void drawMixerSource(const char* name, int source) {
+    float gain = kit.mixer.gain(source);
+    float pan = kit.mixer.pan(source);
+    ImGui::PushID(source);
+    if (ImGui::SliderFloat(name, &gain, 0, 2)) kit.mixer.gain(source, gain);
+    if (ImGui::SliderFloat("pan", &pan, -1, 1)) kit.mixer.pan(source, pan);
+    ImGui::PopID();
+  }
+
   void onDraw(Graphics& g) override {
     g.clear();
-    synthManager.render(g);
-
     imguiDraw();
   }
 
   bool onKeyDown(Keyboard const& k) override {
-    
-    // testing grounds
-    if(k.key() == 'e') playSnare(0, 0.2);
-    if(k.key() == 'w') playSnare(0, 2);
-    if(k.key() == 'q') playKick(150, 0, 0.4, 0.9);
-
-    if(k.key() == '1') playKick(50, 0, 0.4, 0.9);
-    if(k.key() == '2') playKick(100, 0, 0.4, 0.9);
-    if(k.key() == '3') playKick(150, 0, 0.4, 0.9);
-    if(k.key() == '4') playKick(200, 0, 0.4, 0.9);
-    if(k.key() == '5') playKick(250, 0, 0.4, 0.9);
-    if(k.key() == '6') playKick(300, 0, 0.4, 0.9);
-
-    if(k.key() == 'g') playReggaeton(96,0);
-
-    if(k.key() == 'd') playBackbeat(110);
-    if(k.key() == 'a') {
-      playBackbeat(110, 0);
-      playBackbeat(110, 1, 'b');
-      playBackbeat(110, 2);
-      playBackbeat(110, 3, 'b');
-      if(hasSample){
-        samplePlayer.reset();
-        paused = false;
-      }
-      
-    }
-    if(k.key() == 's'){
+    return playKey(k.key());
+  }
+
+  // Key handling, shared by the keyboard and offline rendering
+  bool playKey(int key) {
+    kit.playKey(key);
+
+    // backbeat4 plays along with the clip
+    if(key == 'a' && hasSample){
       samplePlayer.reset();
       paused = false;
     }
-
-    if(k.key() == 'h'){
-      for(int i=0; i<4; i++){
-        playHouse(140, i);
-      }
+    if(key == 's'){
+      samplePlayer.reset();
+      paused = false;
     }
 
     return true;
   }
 
-  bool onKeyUp(Keyboard const& k) override {
-    int midiNote = asciiToMIDI(k.key());
-    if (midiNote > 0) {
-      synthManager.triggerOff(midiNote);
-      synthManager.triggerOff(midiNote - 24);  // Trigger both off for safety
-    }
-    return true;
-  }
-
   void onExit() override { imguiShutdown(); }
 
-  void playKick(float freq, float time, float duration = 0.5, float amp = 0.2, float attack = 0.01, float decay = 0.1)
-  {
-      auto *voice = synthManager.synth().getVoice<Kick>();
-      // amp, freq, attack, release, pan
-      voice->setTriggerParams({amp, freq, 0.01, 0.1, 0.0});
-      voice->setInternalParameterValue("freq", freq);
-      synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
+  // Renders the pattern on key as fast as possible into a wav file
+  void renderOffline(const char* path, double seconds, int key) {
+    double sampleRate = audioIO().framesPerSecond();
+    onInit();
+    playKey(key);
+
+    engine::render_stats stats = engine::renderOffline(
+        path, seconds, [&](AudioIOData& io) { onSound(io); },
+        sampleRate, audioIO().framesPerBuffer(), audioIO().channelsOut());
+    printf("Rendered %.1f s in %.3f s (%.1fx realtime) to %s\n",
+           stats.audioSeconds, stats.wallSeconds, stats.realtimeFactor(), path);
+    printf("Voices: %d active at end, %d peak\n", kit.voices.active(), kit.voices.peak());
+    printf("Pools (high water/capacity, steals, drops): kick %d/%d %ld %ld, hihat %d/%d %ld %ld, snare %d/%d %ld %ld\n",
+           kit.kicks.highWater(), kit.kicks.capacity(), kit.kicks.steals(), kit.kicks.drops(),
+           kit.hihats.highWater(), kit.hihats.capacity(), kit.hihats.steals(), kit.hihats.drops(),
+           kit.snares.highWater(), kit.snares.capacity(), kit.snares.steals(), kit.snares.drops());
+    printf("Player: %ld request overflows, %ld note off overflows\n",
+           kit.player.requestOverflows(), kit.player.noteOverflows());
+    printf("Sample: %ld underruns, %ld frames of silence\n",
+           samplePlayer.underruns(), samplePlayer.underrunFrames());
+    engine::profile_snapshot p = profiler.snapshot();
+    printf("Blocks: %.3f ms p50, %.3f ms p99, %.3f ms max of %.3f ms, %ld/%ld late\n",
+           p.percentile(0.5) * 1e-6, p.percentile(0.99) * 1e-6, p.maxNs * 1e-6,
+           p.deadlineNs * 1e-6, p.misses, p.blocks);
   }
 
-  void playHihat(float time, float duration = 0.3)
-  {
-      auto *voice = synthManager.synth().getVoice<Hihat>();
-      // amp, freq, attack, release, pan
-      synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
+  // Renders the pattern on key into a wav file like renderOffline(), cut
+  // into chunks rendered on workers threads at once (see
+  // DrumKit::renderChunks). A chunk's hits ring out for up to tailSeconds.
+  void exportSession(const char* path, double seconds, int key, int workers,
+                     double chunkSeconds, double tailSeconds) {
+    double sampleRate = audioIO().framesPerSecond();
+    int framesPerBuffer = audioIO().framesPerBuffer();
+    onInit();
+    playKey(key);
+
+    engine::render_stats stats = kit.renderChunks(
+        path, seconds, key, workers, chunkSeconds, tailSeconds, [&](AudioIOData& io) { mix(io); },
+        sampleRate, framesPerBuffer, audioIO().channelsOut());
+    printf("Exported %.1f s in %.3f s (%.1fx realtime, %d workers, %g s chunks) to %s\n",
+           stats.audioSeconds, stats.wallSeconds, stats.realtimeFactor(), workers,
+           chunkSeconds, path);
   }
 
-  void playSnare(float time, float duration = 0.3)
-  {
-      auto *voice = synthManager.synth().getVoice<Snare>();
-      // amp, freq, attack, release, pan
-      synthManager.synthSequencer().addVoiceFromNow(voice, time, duration);
-  }
-
-  void playBackbeat(float tempo, int bar=0, char take='a'){
-    float beat = 60./tempo;
-    float offset = 4*bar*beat;
-
-    for(int i=0; i<8; i++){
-      float time = (i/2.)*beat;
-      playHihat(time+offset);
+  // Plays every key's pattern under the real-time guard (build with
+  // -DENGINE_RT_GUARD), returns the number of violations found
+  long rtCheck(double seconds) {
+    double sampleRate = audioIO().framesPerSecond();
+    onInit();
+    engine::rtGuardInstall();
+
+    for (const char* key = "123456qwegdahl"; *key; key++) {
+      playKey(*key);
+      engine::renderBlocks(
+          seconds, [&](AudioIOData& io) { onSound(io); }, [](AudioIOData&, int) {},
+          sampleRate, audioIO().framesPerBuffer(), audioIO().channelsOut());
     }
-
-    switch(take){
-      case 'a':
-        playKick(100, 0*beat+offset, 0.4, 0.9);
-        playKick(100, 2*beat+offset, 0.4, 0.9);
-        break;
-      case 'b':
-        playKick(100, 0*beat+offset, 0.4, 0.9);
-        playKick(100, 2*beat+offset, 0.4, 0.9);
-        playKick(100, 2.5*beat+offset, 0.4, 0.9);
-        break;
-    }
-    
-    playSnare(1*beat+offset, 0.1);
-    playSnare(3*beat+offset, 0.1);
+    engine::rt_violations v = engine::rtViolations();
+    printf("Real-time guard: %ld allocations, %ld locks, %ld iostream writes on the audio thread\n",
+           v.allocations, v.locks, v.iostream);
+    return v.total();
   }
+};
 
-  void playHouse(float tempo, int bar=0){
-    float beat = 60./tempo;
-    float offset = 4*bar*beat;
+int main(int argc, char* argv[]) {
+  MyApp app;
 
-    playHihat(0.5*beat+offset);
-    playHihat(1.5*beat+offset);
-    playHihat(2.5*beat+offset);
-    playHihat(3.5*beat+offset);
+  // Offline render, no window or audio device:
+  //   Drum_Demo --render out.wav [seconds] [key] [block size]
+  // Same on several threads, for long sessions (default: a minute of 'l'):
+  //   Drum_Demo --export out.wav [seconds] [key] [workers] [chunk seconds] [tail seconds]
+  // Real-time safety check of every key, in a -DENGINE_RT_GUARD build:
+  //   Drum_Demo --rt-check [seconds per key]
+  bool render = argc > 2 && std::string(argv[1]) == "--render";
+  bool exportSession = argc > 2 && std::string(argv[1]) == "--export";
+  bool rtCheck = argc > 1 && std::string(argv[1]) == "--rt-check";
 
+  // Set up audio
+  app.configureAudio(48000., render && argc > 5 ? atoi(argv[5]) : 512, 2, 0);
 
-    playKick(100, 0*beat+offset, 0.4, 0.9);
-    playKick(100, 2.5*beat+offset, 0.4, 0.9);
-    playKick(100, 3.5*beat+offset, 0.4, 0.9);
-    playSnare(1*beat+offset, 0.1);
-    playSnare(3*beat+offset, 0.1);
+  if (render) {
+    double seconds = argc > 3 ? atof(argv[3]) : 10;
+    int key = argc > 4 ? argv[4][0] : 'h';
+    app.renderOffline(argv[2], seconds, key);
+    return 0;
   }
 
-  void playReggaeton(float tempo, int bar=0){
-    float beat = 60./tempo;
-    float offset = 4*bar*beat;
-
-    playKick(150, 0*beat+offset, 0.4, 0.9);
-    playKick(150, 1*beat+offset, 0.4, 0.9);
-    playKick(150, 2*beat+offset, 0.4, 0.9);
-    playKick(150, 3*beat+offset, 0.4, 0.9);
-
-    playSnare(0.75*beat+offset, 0.1);
-    playSnare(1.5*beat+offset, 0.1);
-    playSnare(2.75*beat+offset, 0.1);
-    playSnare(3.5*beat+offset, 0.1);
+  if (exportSession) {
+    double seconds = argc > 3 ? atof(argv[3]) : 60;
+    int key = argc > 4 ? argv[4][0] : 'l';
+    int workers = argc > 5 ? atoi(argv[5]) : std::max<int>(std::thread::hardware_concurrency(), 1);
+    double chunkSeconds = argc > 6 ? atof(argv[6]) : 15;
+    double tailSeconds = argc > 7 ? atof(argv[7]) : 4;
+    app.exportSession(argv[2], seconds, key, workers, chunkSeconds, tailSeconds);
+    return 0;
   }
 
-
-};
-
-int main() {
-  MyApp app;
-
-  // Set up audio
-  app.configureAudio(48000., 512, 2, 0);
+  if (rtCheck) {
+    if (!engine::rtguard::enabled) {
+      printf("Build with -DENGINE_RT_GUARD to check real-time safety\n");
+      return 2;
+    }
+    return app.rtCheck(argc > 2 ? atof(argv[2]) : 2) ? 1 : 0;
+  }
 
   app.start();
 }
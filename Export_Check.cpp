@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Gamma/Gamma.h"
+
+#include "al/io/al_AudioIOData.hpp"
+
+#include "audio_engine/offline.h"
+#include "audio_engine/wavreader.h"
+
+#include "drum_kit.h"
+
+// Headless check of Drum_Demo's export: no window, no audio device.
+// For a few keys, the session is rendered serially, the way the demo's
+// onSound() plays it, and with DrumKit::renderChunks on 1 worker thread
+// and on all of them, each from a fresh kit. The chunked files are read
+// back and must match bit for bit, every sample: the worker count must
+// not change the file. Against the serial render they may differ by
+// float rounding where hits overlap a chunk start, so the largest
+// difference is reported and must stay under the tolerance. Wall times
+// are reported as measured, the speedup is the serial render's time over
+// the chunked one's on all workers.
+// Prints one JSON object to stdout and exits with 1 if a check fails.
+// Writes its files to the current directory and removes them.
+//
+//   Export_Check [seconds per key] [chunk seconds] [tail seconds]
+
+const static double sampleRate = 48000;
+const static int framesPerBuffer = 512;
+const static int channels = 2;
+const static float tolerance = 1e-5f;
+
+struct comparison {
+  int64_t frames = 0;
+  int64_t differing = 0;  // samples whose bits differ
+  float maxDifference = 0;
+  bool read = false;      // both files read to the end, same length
+};
+
+struct check_result {
+  char key;
+  comparison workers;     // all workers against 1
+  comparison serial;      // 1 worker against the serial render
+  double serialSeconds = 0;
+  double oneSeconds = 0;
+  double allSeconds = 0;
+  bool ok = false;
+};
+
+// the end of Drum_Demo's onSound(), without the clip
+void mix(DrumKit& kit, al::AudioIOData& io) {
+  kit.mixer.mix(io.outBuffer(0), io.outBuffer(1), io.framesPerBuffer());
+}
+
+// compares two wav files sample by sample
+comparison compare(const std::string& a, const std::string& b) {
+  comparison r;
+  engine::WavReader ra, rb;
+  if (!ra.open(a) || !rb.open(b) || ra.frames() != rb.frames() || ra.channels() != rb.channels()) return r;
+  r.frames = ra.frames();
+  std::vector<float> ba(4096 * channels), bb(4096 * channels);
+  for (;;) {
+    int na = ra.read(ba.data(), 4096);
+    int nb = rb.read(bb.data(), 4096);
+    if (na != nb) return r;
+    if (na == 0) break;
+    for (int i = 0; i < na * channels; i++) {
+      if (memcmp(&ba[i], &bb[i], sizeof(float)) == 0) continue;
+      r.differing++;
+      r.maxDifference = std::max(r.maxDifference, std::abs(ba[i] - bb[i]));
+    }
+  }
+  r.read = true;
+  return r;
+}
+
+// Drum_Demo --export of key on a fresh kit, returns its wall time
+double renderChunks(char key, const std::string& path, double seconds, int workers,
+                    double chunkSeconds, double tailSeconds) {
+  DrumKit kit;
+  kit.init(sampleRate, framesPerBuffer);
+  engine::render_stats stats = kit.renderChunks(
+      path, seconds, key, workers, chunkSeconds, tailSeconds, [&](al::AudioIOData& io) { mix(kit, io); },
+      sampleRate, framesPerBuffer, channels);
+  return stats.wallSeconds;
+}
+
+check_result run(char key, double seconds, int workers, double chunkSeconds, double tailSeconds) {
+  check_result r;
+  r.key = key;
+  std::string serialPath = std::string("Export_Check_serial_") + key + ".wav";
+  std::string onePath = std::string("Export_Check_one_") + key + ".wav";
+  std::string allPath = std::string("Export_Check_all_") + key + ".wav";
+
+  bool rendered = true;
+  try {
+    // Drum_Demo --render
+    DrumKit kit;
+    kit.init(sampleRate, framesPerBuffer);
+    kit.playKey(key);
+    engine::render_stats stats = engine::renderOffline(
+        serialPath, seconds,
+        [&](al::AudioIOData& io) {
+          kit.render(io);
+          kit.renderReverb(io.framesPerBuffer());
+          mix(kit, io);
+        },
+        sampleRate, framesPerBuffer, channels);
+    r.serialSeconds = stats.wallSeconds;
+
+    r.oneSeconds = renderChunks(key, onePath, seconds, 1, chunkSeconds, tailSeconds);
+    r.allSeconds = renderChunks(key, allPath, seconds, workers, chunkSeconds, tailSeconds);
+  } catch (...) {
+    rendered = false;
+  }
+
+  if (rendered) {
+    r.workers = compare(onePath, allPath);
+    r.serial = compare(serialPath, onePath);
+    r.ok = r.workers.read && r.workers.differing == 0 && r.serial.read &&
+           r.serial.maxDifference <= tolerance;
+  }
+  std::remove(serialPath.c_str());
+  std::remove(onePath.c_str());
+  std::remove(allPath.c_str());
+  return r;
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 30;
+  double chunkSeconds = argc > 2 ? atof(argv[2]) : 4;
+  double tailSeconds = argc > 3 ? atof(argv[3]) : 2;
+  int workers = std::max<int>(std::thread::hardware_concurrency(), 2);
+  gam::sampleRate(sampleRate);
+
+  std::vector<check_result> results;
+  for (const char* key = "1wdaghl"; *key; key++)
+    results.push_back(run(*key, seconds, workers, chunkSeconds, tailSeconds));
+
+  bool ok = true;
+  printf("{\n");
+  printf("  \"seconds_per_key\": %g,\n", seconds);
+  printf("  \"chunk_seconds\": %g,\n", chunkSeconds);
+  printf("  \"tail_seconds\": %g,\n", tailSeconds);
+  printf("  \"workers\": %d,\n", workers);
+  printf("  \"hardware_threads\": %d,\n", (int)std::thread::hardware_concurrency());
+  printf("  \"tolerance\": %g,\n", tolerance);
+  printf("  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const check_result& r = results[i];
+    printf("    {\"key\": \"%c\", \"frames\": %ld, \"differing_across_workers\": %ld, "
+           "\"differing_from_serial\": %ld, \"max_difference_from_serial\": %g, "
+           "\"serial_seconds\": %.3f, \"one_worker_seconds\": %.3f, \"all_workers_seconds\": %.3f, "
+           "\"speedup\": %.2f, \"ok\": %s}%s\n",
+           r.key, (long)r.workers.frames, (long)r.workers.differing, (long)r.serial.differing,
+           r.serial.maxDifference, r.serialSeconds, r.oneSeconds, r.allSeconds,
+           r.allSeconds > 0 ? r.serialSeconds / r.allSeconds : 0, r.ok ? "true" : "false",
+           i + 1 == results.size() ? "" : ",");
+    ok = ok && r.ok;
+  }
+  printf("  ],\n");
+  printf("  \"ok\": %s\n", ok ? "true" : "false");
+  printf("}\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,459 @@
+// allocations are counted by the real-time guard, so it is always on here
+#ifndef ENGINE_RT_GUARD
+#define ENGINE_RT_GUARD
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "audio_engine/rtguard.h"
+
+#include "note_tempo_abstraction/note.h"
+#include "note_tempo_abstraction/notebatch.h"
+#include "note_tempo_abstraction/tempo.h"
+
+// Headless benchmark of the note helpers: no window, no audio device.
+// Midi to frequency conversion is timed per note (Note::frequency() in a
+// loop, the way the demos did it) and in one batch (theory::frequencies /
+// helper::midiToFrequency), at a few list sizes, plain and with a cents
+// detune per note. The batch output is checked against the loop's.
+// Note::frequency() is also checked against the pow() formula it replaced,
+// over every midi note at a few tunings, and switching between tunings is
+// timed and checked not to move or change the tables.
+// Note names are parsed with the std::regex parser the string_view one
+// replaced and with helper::parseString(), timed and with heap allocations
+// counted, and both are checked to accept and reject the same names.
+// Chord symbols are checked against their expected intervals, and a few
+// invalid ones against the grammar the regex parser had. TempoMap is
+// checked against frames worked out by hand around tempo and meter changes.
+// Prints one JSON object to stdout, so runs can be diffed across commits,
+// and exits with 1 if an accuracy check failed. Link with -ldl.
+//
+//   Note_Bench [seconds per case]
+
+using namespace theory;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// runs f until seconds have passed (at least once), returns ns per call
+template <class F>
+double timeCase(double seconds, F f) {
+  long calls = 0;
+  auto start = bench_clock::now();
+  double ns = 0;
+  do {
+    f();
+    calls++;
+    ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+  } while (ns < seconds * 1e9);
+  return ns / calls;
+}
+
+// largest |a - b| / b over n values
+double maxRelativeError(const float* a, const float* b, int n) {
+  double worst = 0;
+  for (int i = 0; i < n; i++) worst = std::max(worst, std::fabs((double)a[i] - b[i]) / b[i]);
+  return worst;
+}
+
+struct batch_result {
+  int notes;
+  bool cents;
+  double loopNsPerNote;
+  double batchNsPerNote;
+  double maxRelativeError;  // batch against the loop
+};
+
+batch_result runBatch(int n, bool detune, double seconds) {
+  std::mt19937 rng(n);
+  std::vector<Note> notes;
+  std::vector<int> midi;
+  std::vector<float> cents;
+  for (int i = 0; i < n; i++) {
+    int m = 21 + rng() % 88;  // piano range
+    notes.push_back(Note(m));
+    midi.push_back(m);
+    cents.push_back((float)((int)(rng() % 101) - 50));
+  }
+  std::vector<float> loop(n), batch(n);
+
+  batch_result r;
+  r.notes = n;
+  r.cents = detune;
+  if (!detune) {
+    r.loopNsPerNote = timeCase(seconds, [&] {
+      for (int i = 0; i < n; i++) loop[i] = notes[i].frequency();
+    }) / n;
+    r.batchNsPerNote = timeCase(seconds, [&] { frequencies(notes.data(), batch.data(), n); }) / n;
+  } else {
+    r.loopNsPerNote = timeCase(seconds, [&] {
+      for (int i = 0; i < n; i++) loop[i] = notes[i].frequency() * std::pow(2.0f, cents[i] / 1200);
+    }) / n;
+    r.batchNsPerNote = timeCase(seconds, [&] {
+      helper::midiToFrequency(midi.data(), batch.data(), n, 440.0f, cents.data());
+    }) / n;
+  }
+  r.maxRelativeError = maxRelativeError(batch.data(), loop.data(), n);
+  return r;
+}
+
+// Note::frequency() before the tables: 2^(1/12) raised to the distance from A4
+float powFrequency(int midi, float root) {
+  double multiplier = pow(2.0, 1.0 / 12);
+  return (float)(root * pow(multiplier, midi - 69));
+}
+
+const static float tunings[] = {440.0f, 432.0f, 415.3f, 442.0f, 466.16f};
+
+struct accuracy_result {
+  float root;
+  double maxRelativeError;  // against powFrequency
+  bool ok;
+};
+
+// every midi note at root, float rounding of the old formula is the tolerance
+accuracy_result runAccuracy(float root) {
+  accuracy_result r;
+  r.root = root;
+  r.maxRelativeError = 0;
+  for (int m = 0; m < 128; m++) {
+    float expected = powFrequency(m, root);
+    float actual = Note(m).frequency(root);
+    r.maxRelativeError = std::max(r.maxRelativeError, std::fabs((double)actual - expected) / expected);
+  }
+  r.ok = r.maxRelativeError <= 2e-7;
+  return r;
+}
+
+struct tuning_result {
+  int roots;                // tunings alternated between
+  double nsPerCall;         // Note::frequency(root), root changing every call
+  bool stable;              // every root's table stayed at one address, unchanged
+};
+
+// alternates Note::frequency() between roots tunings other than 440
+// (440 is a constant table, these come from the thread's slots)
+tuning_result runTunings(int roots, double seconds) {
+  const float* others = tunings + 1;
+  const helper::frequency_table* tables[helper::frequencyTableSlots];
+  for (int t = 0; t < roots; t++) tables[t] = &helper::frequencyTable(others[t]);
+
+  std::vector<Note> notes;
+  for (int m = 21; m < 109; m++) notes.push_back(Note(m));
+  int n = (int)notes.size();
+  volatile float sink = 0;
+
+  tuning_result r;
+  r.roots = roots;
+  r.nsPerCall = timeCase(seconds, [&] {
+    float sum = 0;
+    for (int i = 0; i < n; i++) sum += notes[i].frequency(others[i % roots]);
+    sink = sum;
+  }) / n;
+
+  // the references from before still hold their own root's table...
+  r.stable = true;
+  for (int t = 0; t < roots; t++) {
+    helper::frequency_table fresh(others[t]);
+    r.stable = r.stable && tables[t]->root == fresh.root && std::equal(fresh.hz, fresh.hz + 256, tables[t]->hz);
+  }
+  // ...and asking again gives the same ones
+  for (int t = 0; t < roots; t++) r.stable = r.stable && &helper::frequencyTable(others[t]) == tables[t];
+  return r;
+}
+
+// Note name parsing before the string_view parser: std::regex per character
+const std::regex noteRegex("[a-gA-G]");
+const std::regex signRegex("[#nb]");
+const std::regex octaveRegex("\\-1|[0-9]");
+
+helper::parsed_str regexParseString(std::string str) {
+  std::string toParse = str;
+  helper::parsed_str ret;
+
+  if (str.length() < 1) throw std::out_of_range("Note(string) : input string (" + str + ") is too short");
+
+  if (regex_match(toParse.substr(0, 1), noteRegex)) {
+    ret.note = toParse[0];
+    if (toParse.length() == 1) {
+      ret.sign = 'n';
+      ret.octave = 4;
+      return ret;
+    }
+    toParse = toParse.substr(1);
+  } else {
+    throw std::out_of_range("Note(string) : input string (" + str + ") is invalid (First char is not valid note)");
+  }
+
+  // the old parser left sign unset when an octave followed the letter
+  ret.sign = 'n';
+  if (regex_match(toParse.substr(0, 1), signRegex)) {
+    ret.sign = toParse[0];
+    if (toParse.length() == 1) {
+      ret.octave = 4;
+      return ret;
+    }
+    toParse = toParse.substr(1);
+  }
+
+  if (regex_match(toParse, octaveRegex)) {
+    ret.octave = toParse[0] == '-' ? -1 * atoi(&toParse[1]) : atoi(&toParse[0]);
+    return ret;
+  }
+
+  throw std::out_of_range("Note(string) : input string (" + str + ") is invalid EoF");
+}
+
+// names both parsers accept, and some both reject
+const static char* validNames[] = {"A", "Db5", "C#-1", "Gn3", "e", "Bb", "f#", "G9", "cb0", "An-1", "D2", "B#4"};
+const static char* invalidNames[] = {"", "H4", "Cx", "C10", "Db-2", "A#b", "4", "C#-"};
+
+struct parse_result {
+  double regexNsPerParse;
+  double parserNsPerParse;
+  double regexAllocationsPerParse;
+  double parserAllocationsPerParse;
+  int mismatches;  // names the two parsers disagree on
+};
+
+// heap allocations per call of f, counted by the real-time guard
+template <class F>
+double allocationsPerCall(int calls, F f) {
+  long before = engine::rtViolations().allocations;
+  {
+    engine::RtScope rt;
+    for (int i = 0; i < calls; i++) f();
+  }
+  return (double)(engine::rtViolations().allocations - before) / calls;
+}
+
+parse_result runParse(double seconds) {
+  int count = sizeof(validNames) / sizeof(validNames[0]);
+  volatile int sink = 0;
+  auto regexPass = [&] {
+    for (const char* name : validNames) sink = sink + regexParseString(name).octave;
+  };
+  auto parserPass = [&] {
+    for (const char* name : validNames) sink = sink + helper::parseString(name).octave;
+  };
+
+  parse_result r;
+  r.regexNsPerParse = timeCase(seconds, regexPass) / count;
+  r.parserNsPerParse = timeCase(seconds, parserPass) / count;
+  r.regexAllocationsPerParse = allocationsPerCall(100, regexPass) / count;
+  r.parserAllocationsPerParse = allocationsPerCall(100, parserPass) / count;
+
+  r.mismatches = 0;
+  for (const char* name : validNames) {
+    helper::parsed_str a = regexParseString(name), b = {};
+    bool same = helper::tryParseString(name, b) == helper::parse_ok && a.note == b.note && a.sign == b.sign &&
+                a.octave == b.octave;
+    if (!same) r.mismatches++;
+  }
+  for (const char* name : invalidNames) {
+    bool regexRejects = false;
+    try {
+      regexParseString(name);
+    } catch (const std::out_of_range&) {
+      regexRejects = true;
+    }
+    helper::parsed_str b = {};
+    if (!regexRejects || helper::tryParseString(name, b) == helper::parse_ok) r.mismatches++;
+  }
+  return r;
+}
+
+// chord symbols and the intervals helper::parseChord() should build for them
+struct chord_case {
+  const char* symbol;
+  int intervals[8];
+  int count;
+};
+
+const static chord_case chordCases[] = {
+    {"C", {0, 4, 7}, 3},
+    {"Dm7", {0, 3, 7, 10}, 4},
+    {"Cmaj9", {0, 4, 7, 11, 14}, 5},
+    {"Cm7b5", {0, 3, 6, 10}, 4},
+    {"CMadd9", {0, 4, 7, 14}, 4},
+    {"F/C", {0, 4, 7}, 3},
+    // the bass letter is any of [a-gA-g], as with the regex parser
+    {"Cmaj7/H", {0, 4, 7, 11}, 4},
+};
+// sus chords are left over after the quality, as with the regex parser
+const static char* invalidChords[] = {"Cx", "C7b3", "Csus2", "Csus4", "Csus47", "Csus2b9", "Csus4add9", "Cmaj7/h"};
+
+// symbols that parse to other intervals than expected, or parse when invalid
+int runChords() {
+  int mismatches = 0;
+  for (const chord_case& c : chordCases) {
+    helper::parsed_chord parsed = helper::parseChord(c.symbol);
+    if (parsed.intervals.size() != c.count || !std::equal(c.intervals, c.intervals + c.count, parsed.intervals.begin()))
+      mismatches++;
+  }
+  for (const char* symbol : invalidChords) {
+    try {
+      helper::parseChord(symbol);
+      mismatches++;
+    } catch (const std::out_of_range&) {
+    }
+  }
+  return mismatches;
+}
+
+// TempoMap positions checked against frames worked out by hand: 4/4 at
+// 120 bpm (25 frames per tick at 48 kHz, 960 ppq), 60 bpm (50) from bar 2,
+// 3/4 from bar 4 and 90 bpm (33.3) from bar 5
+struct tempo_result {
+  int checks = 0;
+  int failures = 0;
+};
+
+tempo_result runTempo() {
+  tempo_result r;
+  auto check = [&](bool passed) {
+    r.checks++;
+    if (!passed) r.failures++;
+  };
+
+  TempoMap map(48000, 120, 4, 4);
+  map.setTempo(map.barToTick(2), 60);
+  map.setTimeSignature(4, 3, 4);
+  map.setTempo(map.barToTick(5), 90);
+
+  // bars and beats across the meter change
+  check(map.barToTick(2) == 7680);
+  check(map.barToTick(4) == 15360);
+  check(map.barToTick(4, 1) == 16320);
+  check(map.barToTick(5) == 18240);
+  check(map.barToTick(6) == 21120);
+
+  // ticks on, just before and just after each change
+  check(map.tickToFrame(0) == 0);
+  check(map.tickToFrame(7679) == 191975);
+  check(map.tickToFrame(7680) == 192000);
+  check(map.tickToFrame(7681) == 192050);
+  check(map.tickToFrame(15360) == 576000);
+  check(map.tickToFrame(18239) == 719950);
+  check(map.tickToFrame(18240) == 720000);
+  check(map.tickToFrame(18241) == 720033);
+  check(map.tickToFrame(18242) == 720067);
+  // an hour of 90 bpm later, rounded once rather than accumulated
+  check(map.tickToFrame(18240 + 960 * 5400) == 173520000);
+
+  // frames back to the last tick at or before them
+  check(map.frameToTick(0) == 0);
+  check(map.frameToTick(191999) == 7679);
+  check(map.frameToTick(192000) == 7680);
+  check(map.frameToTick(720000) == 18240);
+  check(map.frameToTick(720032) == 18240);
+
+  // tempo and meter in effect on either side of each change
+  check(map.tempoAt(7679).bpm == 120 && map.tempoAt(7679).timeSig.top == 4);
+  check(map.tempoAt(7680).bpm == 60);
+  check(map.tempoAt(15359).timeSig.top == 4);
+  check(map.tempoAt(15360).timeSig.top == 3 && map.tempoAt(15360).bpm == 60);
+  check(map.tempoAt(18240).bpm == 90 && map.tempoAt(18240).timeSig.top == 3);
+  check(map.tempoAt(1 << 30).bpm == 90);
+
+  // the same changes added out of order give the same frames, and the
+  // playback cursor agrees with the binary search forwards and after a seek back
+  TempoMap reordered(48000, 120, 4, 4);
+  reordered.setTempo(18240, 90);
+  reordered.setTimeSignature(4, 3, 4);
+  reordered.setTempo(7680, 60);
+  bool same = true;
+  for (int64_t tick = 0; tick < 24000; tick++) {
+    same = same && reordered.tickToFrame(tick) == map.tickToFrame(tick);
+    same = same && reordered.playbackFrame(tick) == map.tickToFrame(tick);
+  }
+  for (int64_t tick = 8000; tick < 20000; tick += 7) same = same && reordered.playbackFrame(tick) == map.tickToFrame(tick);
+  check(same);
+
+  return r;
+}
+
+const char* kernelName(helper::batch_kernel kernel) {
+  switch (kernel) {
+    case helper::kernel_avx2: return "avx2";
+    case helper::kernel_neon: return "neon";
+    default: return "scalar";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 0.5;
+  engine::rtguard::reportsLeft.store(0);  // the regex parser allocates on purpose, no call stacks
+
+  const int sizes[] = {1000, 64000, 1000000};
+  std::vector<batch_result> batches;
+  for (int n : sizes) {
+    batches.push_back(runBatch(n, false, seconds));
+    batches.push_back(runBatch(n, true, seconds));
+  }
+
+  bool ok = true;
+  std::vector<accuracy_result> accuracy;
+  for (float root : tunings) {
+    accuracy.push_back(runAccuracy(root));
+    ok = ok && accuracy.back().ok;
+  }
+  parse_result parse = runParse(seconds);
+  ok = ok && parse.mismatches == 0;
+  int chordMismatches = runChords();
+  ok = ok && chordMismatches == 0;
+  tempo_result tempo = runTempo();
+  ok = ok && tempo.failures == 0;
+
+  std::vector<tuning_result> switching;
+  for (int roots = 1; roots <= helper::frequencyTableSlots; roots *= 2)
+    switching.push_back(runTunings(roots, seconds));
+
+  printf("{\n");
+  printf("  \"seconds_per_case\": %g,\n", seconds);
+  printf("  \"batch\": {\"kernel\": \"%s\", \"runs\": [\n", kernelName(helper::batchKernel()));
+  for (size_t i = 0; i < batches.size(); i++) {
+    const batch_result& r = batches[i];
+    printf("    {\"notes\": %d, \"cents\": %s, \"loop_ns_per_note\": %.3f, \"batch_ns_per_note\": %.3f, "
+           "\"speedup\": %.3f, \"max_relative_error\": %.3g}%s\n",
+           r.notes, r.cents ? "true" : "false", r.loopNsPerNote, r.batchNsPerNote,
+           r.loopNsPerNote / r.batchNsPerNote, r.maxRelativeError, i + 1 == batches.size() ? "" : ",");
+  }
+  printf("  ]},\n");
+  printf("  \"accuracy\": [\n");
+  for (size_t i = 0; i < accuracy.size(); i++) {
+    const accuracy_result& r = accuracy[i];
+    printf("    {\"root\": %g, \"max_relative_error\": %.3g, \"ok\": %s}%s\n", r.root,
+           r.maxRelativeError, r.ok ? "true" : "false", i + 1 == accuracy.size() ? "" : ",");
+  }
+  printf("  ],\n");
+  printf("  \"tunings\": [\n");
+  for (size_t i = 0; i < switching.size(); i++) {
+    const tuning_result& r = switching[i];
+    ok = ok && r.stable;
+    printf("    {\"roots\": %d, \"ns_per_call\": %.3f, \"stable\": %s}%s\n", r.roots, r.nsPerCall,
+           r.stable ? "true" : "false", i + 1 == switching.size() ? "" : ",");
+  }
+  printf("  ],\n");
+  printf("  \"parse\": {\"names\": %d, \"regex_ns_per_parse\": %.3f, \"parser_ns_per_parse\": %.3f, "
+         "\"speedup\": %.3f, \"regex_allocations_per_parse\": %.2f, \"parser_allocations_per_parse\": %.2f, "
+         "\"mismatches\": %d},\n",
+         (int)(sizeof(validNames) / sizeof(validNames[0])), parse.regexNsPerParse, parse.parserNsPerParse,
+         parse.regexNsPerParse / parse.parserNsPerParse, parse.regexAllocationsPerParse,
+         parse.parserAllocationsPerParse, parse.mismatches);
+  printf("  \"chords\": {\"symbols\": %d, \"mismatches\": %d},\n",
+         (int)(sizeof(chordCases) / sizeof(chordCases[0]) + sizeof(invalidChords) / sizeof(invalidChords[0])),
+         chordMismatches);
+  printf("  \"tempo\": {\"checks\": %d, \"failures\": %d},\n", tempo.checks, tempo.failures);
+  printf("  \"ok\": %s\n", ok ? "true" : "false");
+  printf("}\n");
+  return ok ? 0 : 1;
+}
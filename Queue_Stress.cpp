@@ -0,0 +1,166 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "audio_engine/queue.h"
+
+// Producer/consumer stress test of engine::SpscQueue.
+// One thread pushes numbered items while another pops them, through small
+// queues so the indices wrap many times:
+//   lossless  - the producer retries when full: every item arrives, in order
+//   overflow  - the producer never retries and the consumer stalls now and
+//               then: what arrives is in order, and arrived + overflows()
+//               adds up to what was pushed
+// Every item also carries a checksum of its number, so a torn copy shows.
+// Run it under -fsanitize=thread too. Prints one JSON object to stdout and
+// exits with 1 if any check failed.
+//
+//   Queue_Stress [items per test]
+
+// a few words, so a half-written item can't pass for a whole one
+struct stress_item {
+  uint64_t seq;
+  uint64_t check;
+  uint64_t pad[2];
+};
+
+uint64_t checksum(uint64_t seq) { return seq * 0x9E3779B97F4A7C15ull ^ 0x5bd1e995ull; }
+
+stress_item makeItem(uint64_t seq) {
+  stress_item item;
+  item.seq = seq;
+  item.check = checksum(seq);
+  item.pad[0] = ~seq;
+  item.pad[1] = item.check + 1;
+  return item;
+}
+
+bool intact(const stress_item& item) {
+  return item.check == checksum(item.seq) && item.pad[0] == ~item.seq && item.pad[1] == item.check + 1;
+}
+
+struct stress_result {
+  const char* name;
+  int capacity;
+  long pushed;      // push() calls
+  long received;
+  long overflows;   // the queue's count
+  long rejected;    // push() calls that returned false
+  long outOfOrder;  // items not after the previous one (lossless: not exactly the next one)
+  long torn;
+  bool ok;
+};
+
+// pushes items numbered 0..items-1, retrying full pushes if lossless,
+// the consumer stalls for a moment every stallEvery items (0 = never)
+template <int Capacity>
+stress_result run(const char* name, long items, bool lossless, long stallEvery) {
+  engine::SpscQueue<stress_item, Capacity> queue;
+  long pushed = 0, rejected = 0;
+  std::atomic<bool> producing{true};
+
+  std::thread producer([&] {
+    for (long seq = 0; seq < items; seq++) {
+      stress_item item = makeItem(seq);
+      for (;;) {
+        pushed++;
+        if (queue.push(item)) break;
+        rejected++;
+        if (!lossless) break;
+        std::this_thread::yield();
+      }
+      // let the consumer in now and then, even on one core
+      if (seq % 64 == 63) std::this_thread::yield();
+    }
+    producing.store(false, std::memory_order_release);
+  });
+
+  long received = 0, outOfOrder = 0, torn = 0;
+  int64_t last = -1;
+  stress_item item;
+  for (;;) {
+    if (!queue.pop(item)) {
+      if (producing.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+        continue;
+      }
+      // every push is visible once producing reads false
+      if (!queue.pop(item)) break;
+    }
+    if (!intact(item)) torn++;
+    int64_t seq = (int64_t)item.seq;
+    if (lossless ? seq != last + 1 : seq <= last) outOfOrder++;
+    last = seq;
+    received++;
+    if (stallEvery && received % stallEvery == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  producer.join();
+
+  stress_result r;
+  r.name = name;
+  r.capacity = Capacity;
+  r.pushed = pushed;
+  r.received = received;
+  r.overflows = queue.overflows();
+  r.rejected = rejected;
+  r.outOfOrder = outOfOrder;
+  r.torn = torn;
+  r.ok = torn == 0 && outOfOrder == 0 && r.overflows == rejected && received + rejected == pushed &&
+         (!lossless || received == items);
+  return r;
+}
+
+// one thread: fills the queue, checks the next push overflows, drains it in order
+stress_result runFill() {
+  engine::SpscQueue<stress_item, 8> queue;
+  stress_result r = {"fill", 8, 0, 0, 0, 0, 0, 0, true};
+  for (int seq = 0; seq < 9; seq++) {
+    r.pushed++;
+    if (!queue.push(makeItem(seq))) r.rejected++;
+  }
+  stress_item item;
+  for (int64_t seq = 0; queue.pop(item); seq++, r.received++) {
+    if ((int64_t)item.seq != seq) r.outOfOrder++;
+    if (!intact(item)) r.torn++;
+  }
+  r.overflows = queue.overflows();
+  r.ok = r.rejected == 1 && r.overflows == 1 && r.received == 8 && r.outOfOrder == 0 && r.torn == 0 &&
+         queue.size() == 0;
+  return r;
+}
+
+void printResult(const stress_result& r, bool last) {
+  printf("    {\"test\": \"%s\", \"capacity\": %d, \"pushed\": %ld, \"received\": %ld, "
+         "\"overflows\": %ld, \"rejected\": %ld, \"out_of_order\": %ld, \"torn\": %ld, \"ok\": %s}%s\n",
+         r.name, r.capacity, r.pushed, r.received, r.overflows, r.rejected, r.outOfOrder, r.torn,
+         r.ok ? "true" : "false", last ? "" : ",");
+}
+
+int main(int argc, char* argv[]) {
+  long items = argc > 1 ? atol(argv[1]) : 2000000;
+
+  stress_result results[] = {
+      runFill(),
+      run<4>("lossless", items, true, 0),
+      run<256>("lossless", items, true, 0),
+      run<4>("overflow", items, false, 1000),
+      run<256>("overflow", items, false, 1000),
+  };
+
+  bool ok = true;
+  int count = sizeof(results) / sizeof(results[0]);
+  printf("{\n");
+  printf("  \"items_per_test\": %ld,\n", items);
+  printf("  \"results\": [\n");
+  for (int i = 0; i < count; i++) {
+    printResult(results[i], i + 1 == count);
+    ok = ok && results[i].ok;
+  }
+  printf("  ],\n");
+  printf("  \"ok\": %s\n", ok ? "true" : "false");
+  printf("}\n");
+  return ok ? 0 : 1;
+}
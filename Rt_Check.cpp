@@ -0,0 +1,138 @@
+// allocations and locks are what this counts, so the guard is always on here
+#ifndef ENGINE_RT_GUARD
+#define ENGINE_RT_GUARD
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "Gamma/Gamma.h"
+
+#include "al/io/al_AudioIOData.hpp"
+
+#include "audio_engine/offline.h"
+#include "audio_engine/rtguard.h"
+
+#include "drum_kit.h"
+#include "note_tempo_abstraction/noteplayer.h"
+
+// Headless real-time safety check of both demos' audio paths: no window,
+// no audio device. Every drum key of Drum_Demo and both songs of
+// Note_Demo_02 are played in 48 kHz / 512 frame blocks through the same
+// DrumKit and NotePlayer the demos' onSound() runs, each block inside an
+// engine::RtScope, so heap allocations, mutex locks and iostream writes on
+// the audio thread are counted (and the first few printed to stderr with
+// their call stack). The songs play on 1 render thread and on all of them.
+// Keys are pressed from this thread between blocks, like the GUI thread
+// would. Prints one JSON object to stdout and exits with 1 if anything was
+// counted. Link with -ldl, and -rdynamic for names in the call stacks.
+//
+//   Rt_Check [seconds per key]
+
+const static double sampleRate = 48000;
+const static int framesPerBuffer = 512;
+
+struct check_result {
+  const char* name;
+  int keys = 0;
+  int64_t blocks = 0;
+  engine::rt_violations violations;
+};
+
+// counts since the last call
+engine::rt_violations since(engine::rt_violations& last) {
+  engine::rt_violations now = engine::rtViolations();
+  engine::rt_violations d;
+  d.allocations = now.allocations - last.allocations;
+  d.locks = now.locks - last.locks;
+  d.iostream = now.iostream - last.iostream;
+  last = now;
+  return d;
+}
+
+// Drum_Demo's onSound() without the clip: hits, voices, reverb, mixer
+check_result runDrums(double seconds) {
+  check_result r;
+  r.name = "drums";
+  engine::rt_violations last = engine::rtViolations();
+
+  DrumKit kit;
+  gam::sampleRate(sampleRate);
+  kit.init(sampleRate, framesPerBuffer);
+  for (const char* key = "123456qwegdahl"; *key; key++) {
+    kit.playKey(*key);
+    r.keys++;
+    engine::renderBlocks(
+        seconds,
+        [&](al::AudioIOData& io) {
+          engine::RtScope rt;
+          int frames = io.framesPerBuffer();
+          kit.render(io);
+          kit.renderReverb(frames);
+          kit.mixer.mix(io.outBuffer(0), io.outBuffer(1), frames);
+        },
+        [&](al::AudioIOData&, int) { r.blocks++; }, sampleRate, framesPerBuffer, 2);
+  }
+  r.violations = since(last);
+  return r;
+}
+
+// Note_Demo_02's onSound(): queued notes, voices on threads render threads
+check_result runSongs(const char* name, double seconds, int threads) {
+  check_result r;
+  r.name = name;
+  engine::rt_violations last = engine::rtViolations();
+
+  NotePlayer player;
+  gam::sampleRate(sampleRate);
+  player.init(sampleRate, framesPerBuffer, threads);
+  for (const char* key = "as"; *key; key++) {
+    player.playKey(*key);
+    r.keys++;
+    engine::renderBlocks(
+        seconds,
+        [&](al::AudioIOData& io) {
+          engine::RtScope rt;
+          player.events(io.framesPerBuffer());
+          player.render(io);
+        },
+        [&](al::AudioIOData&, int) { r.blocks++; }, sampleRate, framesPerBuffer, 2);
+  }
+  r.violations = since(last);
+  return r;
+}
+
+void printResult(const check_result& r, bool last) {
+  printf("    {\"name\": \"%s\", \"keys\": %d, \"blocks\": %ld, \"allocations\": %ld, "
+         "\"locks\": %ld, \"iostream\": %ld}%s\n",
+         r.name, r.keys, (long)r.blocks, r.violations.allocations, r.violations.locks,
+         r.violations.iostream, last ? "" : ",");
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+  int threads = std::max<int>(std::thread::hardware_concurrency(), 2);
+  engine::rtGuardInstall();
+
+  check_result results[] = {
+      runDrums(seconds),
+      runSongs("songs", seconds, 1),
+      runSongs("songs_threaded", seconds, threads),
+  };
+
+  bool ok = true;
+  int count = sizeof(results) / sizeof(results[0]);
+  printf("{\n");
+  printf("  \"seconds_per_key\": %g,\n", seconds);
+  printf("  \"render_threads\": %d,\n", threads);
+  printf("  \"results\": [\n");
+  for (int i = 0; i < count; i++) {
+    printResult(results[i], i + 1 == count);
+    ok = ok && results[i].violations.total() == 0;
+  }
+  printf("  ],\n");
+  printf("  \"ok\": %s\n", ok ? "true" : "false");
+  printf("}\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,529 @@
+// allocations are counted by the real-time guard, so it is always on here
+#ifndef ENGINE_RT_GUARD
+#define ENGINE_RT_GUARD
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "Gamma/Gamma.h"
+
+#include "al/io/al_AudioIOData.hpp"
+#include "al/scene/al_PolySynth.hpp"
+
+#include "audio_engine/parallel.h"
+#include "audio_engine/rtguard.h"
+#include "audio_engine/voices.h"
+
+#include "drum_voices.h"
+#include "note_tempo_abstraction/squarewave.h"
+
+// Headless benchmark of the demo voices: no window, no audio device.
+// Each voice type is rendered at a few polyphonies in 48 kHz / 512 frame
+// blocks, with every finished voice retriggered so the count stays put.
+// Snare runs include the one reverb the drum demo runs over their shared
+// send each block, so its fixed cost shows next to the voices'.
+// A pad of many SquareWave voices is then rendered with ParallelRender on
+// 1 to max threads, for the speedup and to check every thread count gives
+// the same output, then for a second at the pace of a live device to show
+// what the workers cost between blocks. Earlier versions of some voices are kept below as
+// baselines, and each is compared with its current voice at the end.
+// Timed blocks run inside an engine::RtScope, so heap allocations and
+// locks in them are counted (and the first few printed to stderr).
+// Prints one JSON object to stdout, so runs can be diffed across commits.
+// Link with -ldl, and -rdynamic for names in the guard's call stacks.
+//
+//   Voice_Bench [seconds per case] [cpu budget %] [max threads]
+
+using namespace al;
+
+const static double sampleRate = 48000;
+const static int framesPerBuffer = 512;
+
+/* ---------------------------------------------------------------- */
+
+// Baselines: earlier versions of the demo voices, benchmarked next to the
+// current ones so the results show what each change bought
+
+// SquareWave before the wavetable: four gam::Sine partials summed per sample
+class FourSineSquare : public SynthVoice {
+ public:
+  gam::Pan<> mPan;
+  gam::Sine<> mOsc1;
+  gam::Sine<> mOsc3;
+  gam::Sine<> mOsc5;
+  gam::Sine<> mOsc7;
+
+  gam::Env<3> mAmpEnv;
+  bool mReleasing = false;
+
+  engine::SmoothedParameter mAmp;
+  Parameter* mFreq;
+  Parameter* mAttack;
+  Parameter* mRelease;
+  Parameter* mPanPos;
+
+  void init() override {
+    mAmpEnv.curve(0);
+    mAmpEnv.levels(0, 1, 1, 0);
+    mAmpEnv.sustainPoint(2);
+
+    mAmp.bind(createInternalTriggerParameter("amplitude", 0.8, 0.0, 1.0));
+    mFreq = &createInternalTriggerParameter("frequency", 440, 20, 5000);
+    mAttack = &createInternalTriggerParameter("attackTime", 0.1, 0.01, 3.0);
+    mRelease = &createInternalTriggerParameter("releaseTime", 0.1, 0.1, 10.0);
+    mPanPos = &createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+  }
+
+  void onProcess(AudioIOData& io) override {
+    float f = mFreq->get();
+    mOsc1.freq(f);
+    mOsc3.freq(f * 3);
+    mOsc5.freq(f * 5);
+    mOsc7.freq(f * 7);
+
+    mAmpEnv.lengths()[0] = mAttack->get();
+    mAmpEnv.lengths()[2] = mRelease->get();
+    mPan.pos(mPanPos->get());
+
+    mAmp.beginBlock(io.framesPerBuffer());
+    int releaseFrame = mReleasing ? getEndOffsetFrames(io.framesPerBuffer()) : -1;
+    while (io()) {
+      if (io.frame() == releaseFrame) {
+        mAmpEnv.release();
+        mReleasing = false;
+      }
+      float a = mAmp.next();
+      float s1 = mAmpEnv() * (mOsc1() * a + mOsc3() * (a / 3.0) + mOsc5() * (a / 5.0) + mOsc7() * (a / 7.0));
+
+      float s2;
+      mPan(s1, s1, s2);
+      io.out(0) += s1;
+      io.out(1) += s2;
+    }
+    if (mAmpEnv.done()) free();
+  }
+
+  void onTriggerOn() override {
+    mAmpEnv.reset();
+    mAmp.snap();
+    mReleasing = false;
+  }
+  void onTriggerOff() override { mReleasing = true; }
+};
+
+// Kick before the parameter handles: the same voice, but every parameter
+// read is a getInternalParameterValue() lookup by name, amplitude per sample
+class LookupKick : public SynthVoice {
+ public:
+  gam::Pan<> mPan;
+  gam::Sine<> mOsc;
+  gam::Decay<> mDecay;
+  gam::AD<> mAmpEnv;
+  bool mReleasing = false;
+
+  void init() override {
+    mAmpEnv.attack(0.01);
+    mAmpEnv.decay(0.3);
+    mAmpEnv.amp(1.0);
+    mDecay.decay(0.3);
+
+    createInternalTriggerParameter("amplitude", 0.3, 0.0, 1.0);
+    createInternalTriggerParameter("frequency", 60, 20, 5000);
+  }
+
+  void onProcess(AudioIOData& io) override {
+    mOsc.freq(getInternalParameterValue("frequency"));
+    mPan.pos(0);
+
+    float gainL, gainR;
+    engine::panGains(mPan, gainL, gainR);
+
+    int releaseFrame = mReleasing ? getEndOffsetFrames(io.framesPerBuffer()) : -1;
+    auto release = [&] { mAmpEnv.release(); mDecay.finish(); mReleasing = false; };
+    engine::processBlock(io, releaseFrame, release, [&](const engine::block_span& b) {
+      float osc[engine::blockChunk], env[engine::blockChunk], amp[engine::blockChunk];
+      for (int i = 0; i < b.frames; i++) {
+        mOsc.freqMul(mDecay());
+        osc[i] = mOsc();
+      }
+      for (int i = 0; i < b.frames; i++) env[i] = mAmpEnv();
+      for (int i = 0; i < b.frames; i++) amp[i] = getInternalParameterValue("amplitude");
+
+      for (int i = 0; i < b.frames; i++) osc[i] = osc[i] * env[i] * amp[i];
+      engine::mixPanned(b, osc, gainL, gainR);
+    });
+
+    if (mAmpEnv.done()) free();
+  }
+
+  void onTriggerOn() override { mAmpEnv.reset(); mDecay.reset(); mReleasing = false; }
+  void onTriggerOff() override { mReleasing = true; }
+};
+
+// Snare before the shared send: the same voice, but each one runs its own
+// FREEVERB-sized gam::ReverbMS over its signal
+class ReverbSnare : public SynthVoice {
+ public:
+  gam::Pan<> mPan;
+  gam::AD<> mAmpEnv;
+  gam::Sine<> mOsc;
+  gam::Sine<> mOsc2;
+  gam::Decay<> mDecay;
+  gam::ReverbMS<> reverb;
+  gam::Burst mBurst;
+
+  engine::SmoothedParameter mAmp;
+  bool mReleasing = false;
+
+  void init() override {
+    mBurst = gam::Burst(10000, 5000, 0.3);
+    mAmpEnv.attack(0.01);
+    mAmpEnv.decay(0.01);
+    mAmpEnv.amp(1.0);
+    mDecay.decay(0.8);
+
+    reverb.resize(gam::FREEVERB);
+    reverb.decay(0.5);
+    reverb.damping(0.2);
+
+    mAmp.bind(createInternalTriggerParameter("amplitude", 1.0, 0.0, 1.0));
+  }
+
+  void onProcess(AudioIOData& io) override {
+    mOsc.freq(200);
+    mOsc2.freq(150);
+
+    float gainL, gainR;
+    engine::panGains(mPan, gainL, gainR);
+
+    mAmp.beginBlock(io.framesPerBuffer());
+    int releaseFrame = mReleasing ? getEndOffsetFrames(io.framesPerBuffer()) : -1;
+    auto release = [&] { mAmpEnv.release(); mDecay.finish(); mReleasing = false; };
+    engine::processBlock(io, releaseFrame, release, [&](const engine::block_span& b) {
+      float osc[engine::blockChunk], osc2[engine::blockChunk];
+      float env[engine::blockChunk], noise[engine::blockChunk], gain[engine::blockChunk];
+      for (int i = 0; i < b.frames; i++) {
+        float decay = mDecay();
+        mOsc.freqMul(decay);
+        mOsc2.freqMul(decay);
+        osc[i] = mOsc();
+        osc2[i] = mOsc2();
+      }
+      for (int i = 0; i < b.frames; i++) env[i] = mAmpEnv();
+      for (int i = 0; i < b.frames; i++) noise[i] = mBurst();
+      for (int i = 0; i < b.frames; i++) gain[i] = mAmp.next();
+
+      for (int i = 0; i < b.frames; i++) {
+        float amp = env[i];
+        noise[i] = (noise[i] + (osc[i] * amp * 0.1) + (osc2[i] * amp * 0.05)) * gain[i];
+        noise[i] += reverb(noise[i]) * 0.2;
+      }
+      engine::mixPanned(b, noise, gainL, gainR);
+    });
+
+    if (mAmpEnv.done()) free();
+  }
+  void onTriggerOn() override { mBurst.reset(); mAmpEnv.reset(); mDecay.reset(); mAmp.snap(); mReleasing = false; }
+  void onTriggerOff() override { mReleasing = true; }
+};
+
+// a current voice and the baseline it replaced
+struct comparison {
+  const char* voice;
+  const char* baseline;
+};
+
+const static comparison comparisons[] = {
+    {"Kick", "LookupKick"},
+    {"Snare", "ReverbSnare"},
+    {"SquareWave", "FourSineSquare"},
+};
+
+/* ---------------------------------------------------------------- */
+
+struct bench_result {
+  const char* voice;
+  int polyphony;
+  long blocks;
+  double nsPerVoiceSample;  // render time per voice per frame
+  double blockMeanNs;
+  double blockMaxNs;
+  double cpuPercent;        // mean block time / block period
+  int maxPolyphony;         // voices that fit in the cpu budget
+  long allocations;         // during the timed blocks
+  long locks;
+};
+
+// pitch of the n-th voice of a case, spread over a few octaves
+float benchPitch(int n) { return 110.0f * (1 << (n % 5)) * (1.0f + 0.07f * (n % 7)); }
+
+// Starts voices from the pool until polyphony are sounding, as the demos
+// start their notes
+template <class Voice>
+void fillVoices(engine::VoicePool<Voice>& pool, int polyphony, bool setPitch, int& nextId) {
+  for (int n = polyphony - pool.active(); n > 0; n--) {
+    Voice* voice = pool.acquire();
+    if (!voice) break;
+    if (setPitch) voice->setInternalParameterValue("frequency", benchPitch(nextId));
+    pool.triggerOn(voice, 0, nextId++);
+  }
+}
+
+// seconds of blocks with polyphony Voices sounding, after one second of warm up,
+// with sharedReverb the demo's reverb runs over the snares' send after the voices
+template <class Voice>
+bench_result runVoice(const char* name, int polyphony, double seconds,
+                      double budgetPercent, bool setPitch, bool sharedReverb = false) {
+  AudioIOData io;
+  io.framesPerSecond(sampleRate);
+  io.framesPerBuffer(framesPerBuffer);
+  io.channelsIn(0);
+  io.channelsOut(2);
+  engine::AuxBus reverbSend;
+  reverbSend.prepare(framesPerBuffer);
+
+  // set up as in Drum_Demo, returned at the reverb bus's 0.2 gain
+  gam::ReverbMS<> reverb;
+  gam::Pan<> reverbPan;
+  reverb.resize(gam::FREEVERB);
+  reverb.decay(0.5);
+  reverb.damping(0.2);
+
+  engine::VoicePool<Voice> pool;
+  pool.allocate(polyphony, engine::steal_oldest, 0);
+  if constexpr (std::is_same<Voice, Snare>::value)
+    for (int i = 0; i < pool.size(); i++) pool.voice(i).mSend = &reverbSend;
+  int nextId = 0;
+
+  long warmup = (long)(sampleRate / framesPerBuffer);
+  long blocks = (long)(seconds * sampleRate / framesPerBuffer);
+  double totalNs = 0, maxNs = 0;
+
+  engine::rt_violations before;
+  for (long b = -warmup; b < blocks; b++) {
+    if (b == 0) before = engine::rtViolations();
+    auto start = std::chrono::steady_clock::now();
+    auto block = [&] {
+      fillVoices(pool, polyphony, setPitch, nextId);
+      io.zeroOut();
+      io.frame(0);
+      pool.render(io);
+      if (sharedReverb) {
+        for (int i = 0; i < framesPerBuffer; i++) {
+          float wetL, wetR;
+          reverbPan(reverb(reverbSend[i]) * 0.2f, wetL, wetR);
+          io.outBuffer(0)[i] += wetL;
+          io.outBuffer(1)[i] += wetR;
+        }
+      }
+      reverbSend.clear();
+    };
+    if (b < 0) block();
+    else {
+      engine::RtScope rt;
+      block();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (b >= 0) {
+      totalNs += ns;
+      if (ns > maxNs) maxNs = ns;
+    }
+  }
+  engine::rt_violations after = engine::rtViolations();
+
+  bench_result r;
+  r.voice = name;
+  r.polyphony = polyphony;
+  r.blocks = blocks;
+  r.blockMeanNs = totalNs / blocks;
+  r.blockMaxNs = maxNs;
+  r.nsPerVoiceSample = r.blockMeanNs / ((double)polyphony * framesPerBuffer);
+
+  double periodNs = 1e9 * framesPerBuffer / sampleRate;
+  r.cpuPercent = 100 * r.blockMeanNs / periodNs;
+  r.maxPolyphony = (int)(periodNs * budgetPercent / 100 / (r.nsPerVoiceSample * framesPerBuffer));
+  r.allocations = after.allocations - before.allocations;
+  r.locks = after.locks - before.locks;
+  return r;
+}
+
+struct scaling_result {
+  int threads;
+  double blockMeanNs;
+  double speedup;        // one thread's block time / this one's
+  bool matchesOneThread; // output identical to the one thread run
+  double pacedCpuPercent; // process cpu, in % of one core, with a block due every period
+  long allocations;
+  long locks;
+};
+
+const static int padPolyphony = 256;
+
+// seconds of a padPolyphony SquareWave pad through renderer on threads,
+// out gets every block's output (the first run's is the reference)
+scaling_result runParallel(engine::ParallelRender& renderer, int threads, double seconds,
+                           std::vector<float>& out) {
+  AudioIOData io;
+  io.framesPerSecond(sampleRate);
+  io.framesPerBuffer(framesPerBuffer);
+  io.channelsIn(0);
+  io.channelsOut(2);
+  renderer.threads(threads);
+
+  engine::VoicePool<SquareWave> pool;
+  pool.allocate(padPolyphony, engine::steal_oldest, 0);
+  int nextId = 0;
+
+  long warmup = (long)(sampleRate / framesPerBuffer);
+  long blocks = (long)(seconds * sampleRate / framesPerBuffer);
+  double totalNs = 0;
+  out.clear();
+  out.reserve((warmup + blocks) * framesPerBuffer * 2);
+
+  engine::rt_violations before;
+  for (long b = -warmup; b < blocks; b++) {
+    if (b == 0) before = engine::rtViolations();
+    auto start = std::chrono::steady_clock::now();
+    auto block = [&] {
+      fillVoices(pool, padPolyphony, true, nextId);
+      io.zeroOut();
+      io.frame(0);
+      renderer.render(pool.voices(), io);
+      pool.update();
+    };
+    if (b < 0) block();
+    else {
+      engine::RtScope rt;
+      block();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (b >= 0) totalNs += ns;
+    for (int c = 0; c < 2; c++) out.insert(out.end(), io.outBuffer(c), io.outBuffer(c) + framesPerBuffer);
+  }
+
+  // a second of blocks at real time: render, then sleep until the next is due
+  rusage usageBefore, usageAfter;
+  getrusage(RUSAGE_SELF, &usageBefore);
+  auto pacedStart = std::chrono::steady_clock::now();
+  auto due = pacedStart;
+  auto period = std::chrono::nanoseconds((long)(1e9 * framesPerBuffer / sampleRate));
+  for (long b = 0; b < warmup; b++) {
+    fillVoices(pool, padPolyphony, true, nextId);
+    io.zeroOut();
+    io.frame(0);
+    renderer.render(pool.voices(), io);
+    pool.update();
+    due += period;
+    std::this_thread::sleep_until(due);
+  }
+  getrusage(RUSAGE_SELF, &usageAfter);
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - pacedStart).count();
+  auto cpuSeconds = [](const rusage& u) {
+    return u.ru_utime.tv_sec + u.ru_stime.tv_sec + 1e-6 * (u.ru_utime.tv_usec + u.ru_stime.tv_usec);
+  };
+
+  scaling_result r;
+  r.threads = threads;
+  r.pacedCpuPercent = 100 * (cpuSeconds(usageAfter) - cpuSeconds(usageBefore)) / wall;
+  r.blockMeanNs = totalNs / blocks;
+  r.speedup = 1;
+  r.matchesOneThread = true;
+  engine::rt_violations after = engine::rtViolations();
+  r.allocations = after.allocations - before.allocations;
+  r.locks = after.locks - before.locks;
+  return r;
+}
+
+const bench_result* findResult(const std::vector<bench_result>& results, const char* voice, int polyphony) {
+  for (const bench_result& r : results)
+    if (!strcmp(r.voice, voice) && r.polyphony == polyphony) return &r;
+  return nullptr;
+}
+
+void printResult(const bench_result& r, bool last) {
+  printf("    {\"voice\": \"%s\", \"polyphony\": %d, \"blocks\": %ld, "
+         "\"ns_per_voice_sample\": %.3f, \"block_mean_ns\": %.0f, \"block_max_ns\": %.0f, "
+         "\"cpu_percent\": %.3f, \"max_polyphony\": %d, \"allocations\": %ld, \"locks\": %ld}%s\n",
+         r.voice, r.polyphony, r.blocks, r.nsPerVoiceSample, r.blockMeanNs, r.blockMaxNs,
+         r.cpuPercent, r.maxPolyphony, r.allocations, r.locks, last ? "" : ",");
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 2;
+  double budgetPercent = argc > 2 ? atof(argv[2]) : 50;
+  int maxThreads = argc > 3 ? atoi(argv[3]) : std::max<int>(std::thread::hardware_concurrency(), 1);
+  maxThreads = std::min(std::max(maxThreads, 1), (int)engine::ParallelRender::maxThreads);
+
+  // Gamma objects read the sample rate when they are built
+  gam::sampleRate(sampleRate);
+  engine::rtGuardInstall();
+
+  const int polyphonies[] = {1, 16, 64, 128};
+  std::vector<bench_result> results;
+  for (int polyphony : polyphonies) {
+    results.push_back(runVoice<Kick>("Kick", polyphony, seconds, budgetPercent, true));
+    results.push_back(runVoice<LookupKick>("LookupKick", polyphony, seconds, budgetPercent, true));
+    results.push_back(runVoice<Hihat>("Hihat", polyphony, seconds, budgetPercent, false));
+    results.push_back(runVoice<Snare>("Snare", polyphony, seconds, budgetPercent, false, true));
+    results.push_back(runVoice<ReverbSnare>("ReverbSnare", polyphony, seconds, budgetPercent, false));
+    results.push_back(runVoice<SquareWave>("SquareWave", polyphony, seconds, budgetPercent, true));
+    results.push_back(runVoice<FourSineSquare>("FourSineSquare", polyphony, seconds, budgetPercent, true));
+  }
+
+  engine::ParallelRender renderer;
+  renderer.prepare(padPolyphony, maxThreads, framesPerBuffer);
+  std::vector<float> reference, out;
+  std::vector<scaling_result> scaling;
+  for (int threads = 1; threads <= maxThreads; threads++) {
+    scaling_result r = runParallel(renderer, threads, seconds, threads == 1 ? reference : out);
+    if (threads > 1) {
+      r.speedup = scaling[0].blockMeanNs / r.blockMeanNs;
+      r.matchesOneThread = out == reference;
+    }
+    scaling.push_back(r);
+  }
+  renderer.stop();
+
+  printf("{\n");
+  printf("  \"sample_rate\": %.0f,\n", sampleRate);
+  printf("  \"frames_per_buffer\": %d,\n", framesPerBuffer);
+  printf("  \"seconds_per_case\": %g,\n", seconds);
+  printf("  \"cpu_budget_percent\": %g,\n", budgetPercent);
+  printf("  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); i++) printResult(results[i], i + 1 == results.size());
+  printf("  ],\n");
+  // both voices' max_polyphony, from the highest polyphony runs
+  int top = polyphonies[sizeof(polyphonies) / sizeof(polyphonies[0]) - 1];
+  int count = sizeof(comparisons) / sizeof(comparisons[0]);
+  printf("  \"comparisons\": [\n");
+  for (int i = 0; i < count; i++) {
+    const bench_result* voice = findResult(results, comparisons[i].voice, top);
+    const bench_result* baseline = findResult(results, comparisons[i].baseline, top);
+    printf("    {\"voice\": \"%s\", \"baseline\": \"%s\", \"polyphony\": %d, "
+           "\"max_polyphony\": %d, \"baseline_max_polyphony\": %d, \"speedup\": %.3f}%s\n",
+           voice->voice, baseline->voice, top, voice->maxPolyphony, baseline->maxPolyphony,
+           baseline->nsPerVoiceSample / voice->nsPerVoiceSample, i + 1 == count ? "" : ",");
+  }
+  printf("  ],\n");
+  printf("  \"scaling\": {\"voice\": \"SquareWave\", \"polyphony\": %d, \"hardware_threads\": %u, \"runs\": [\n",
+         padPolyphony, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < scaling.size(); i++) {
+    const scaling_result& r = scaling[i];
+    printf("    {\"threads\": %d, \"block_mean_ns\": %.0f, \"speedup\": %.3f, "
+           "\"matches_one_thread\": %s, \"paced_cpu_percent\": %.1f, \"allocations\": %ld, "
+           "\"locks\": %ld}%s\n",
+           r.threads, r.blockMeanNs, r.speedup, r.matchesOneThread ? "true" : "false",
+           r.pacedCpuPercent, r.allocations, r.locks, i + 1 == scaling.size() ? "" : ",");
+  }
+  printf("  ]}\n");
+  printf("}\n");
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace engine {
+
+/*
+    AuxBus: mono send buffer shared by all voices for one block
+
+        Voices add their send signal at the current frame, the app then runs
+        one effect over the summed bus and clears it for the next block.
+
+        bus.prepare(io.framesPerBuffer());    // start of onSound()
+        bus.add(io.frame(), s * sendLevel);   // inside a voice's io() loop
+        for(i) out += effect(bus[i]);         // after the synths render
+        bus.clear();
+*/
+class AuxBus {
+    public:
+        // sizes the bus (only allocates when the block size changes)
+        void prepare(int frames){
+            if((int)mBuffer.size() != frames) mBuffer.assign(frames, 0.0f);
+        }
+
+        void clear(){ std::fill(mBuffer.begin(), mBuffer.end(), 0.0f); }
+
+        void add(int frame, float value){ mBuffer[frame] += value; }
+
+        float operator[](int frame) const { return mBuffer[frame]; }
+        float* data(){ return mBuffer.data(); }
+        int frames() const { return (int)mBuffer.size(); }
+
+    private:
+        std::vector<float> mBuffer;
+};
+
+}
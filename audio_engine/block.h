@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+
+#include "al/io/al_AudioIOData.hpp"
+
+namespace engine {
+
+/*
+    Block processing for voices
+
+        Instead of a while (io()) loop that runs every unit generator once per
+        sample, a voice fills small scratch buffers one generator at a time and
+        then mixes the result into the output buffers in one pass. The mixing
+        and arithmetic loops are plain array loops the compiler can vectorize.
+        Gamma's generators only have a per-sample operator(), so each is still
+        called once per sample, but in a tight loop of its own.
+
+        engine::processBlock(io, [&](const engine::block_span& b) {
+            float env[engine::blockChunk];
+            for (int i = 0; i < b.frames; i++) env[i] = mAmpEnv();
+            ...
+            engine::mixPanned(b, mono, gainL, gainR);
+        });
+
+    Starts at the voice's current frame (so sequencer start offsets still
+    apply) and leaves io at the end of the block, like a finished io() loop.
+
+    For a note off on its exact frame, defer onTriggerOff() and pass its
+    offset, the block is split there and release() runs in between:
+
+        void onTriggerOff() override { mReleasing = true; }
+
+        int releaseFrame = mReleasing ? getEndOffsetFrames(io.framesPerBuffer()) : -1;
+        engine::processBlock(io, releaseFrame, [&] { mAmpEnv.release(); mReleasing = false; },
+                             [&](const engine::block_span& b) { ... });
+*/
+
+// frames per scratch buffer, small enough to stay in L1 and on the stack
+const static int blockChunk = 64;
+
+// one chunk of the output block
+struct block_span {
+    int start;   // first frame, index into io buffers / aux buses
+    int frames;  // frames in this chunk, <= blockChunk
+    float* outL;
+    float* outR;
+};
+
+// calls process(block_span) for the rest of the block in blockChunk pieces,
+// and release() once before releaseFrame (-1 or past the block: no release)
+template<class Release, class Process>
+void processBlock(al::AudioIOData& io, int releaseFrame, Release&& release, Process&& process){
+    int start = std::max(io.frame() + 1, 0); // frame the next io() call would visit
+    int end = io.framesPerBuffer();
+    float* outL = io.outBuffer(0);
+    float* outR = io.outBuffer(1);
+    bool released = releaseFrame < 0 || releaseFrame >= end;
+
+    for(int i = start; i < end; ){
+        if(!released && releaseFrame <= i){
+            release();
+            released = true;
+        }
+        int stop = std::min(i + blockChunk, end);
+        if(!released) stop = std::min(stop, releaseFrame);
+
+        block_span b;
+        b.start = i;
+        b.frames = stop - i;
+        b.outL = outL + i;
+        b.outR = outR + i;
+        process(b);
+        i = stop;
+    }
+    if(!released) release(); // no frames of this voice left in the block
+    io.frame(end + 1); // same cursor a finished io() loop leaves
+}
+
+// calls process(block_span) for the rest of the block in blockChunk pieces
+template<class Process>
+void processBlock(al::AudioIOData& io, Process&& process){
+    processBlock(io, -1, []{}, process);
+}
+
+// adds mono into both outputs with constant pan gains
+inline void mixPanned(const block_span& b, const float* mono, float gainL, float gainR){
+    float* outL = b.outL;
+    float* outR = b.outR;
+    for(int i = 0; i < b.frames; i++){
+        outL[i] += mono[i] * gainL;
+        outR[i] += mono[i] * gainR;
+    }
+}
+
+// returns the left/right gains of a panner at its current position
+template<class Pan>
+inline void panGains(Pan& pan, float& gainL, float& gainR){
+    pan(1.0f, gainL, gainR); // the panner is linear in its input
+}
+
+}
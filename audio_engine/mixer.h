@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+#include "auxbus.h"
+
+namespace engine {
+
+/*
+    Mixer: sums stereo sources into the output a block at a time
+
+        Source 0 is whatever was rendered straight into the output buffers
+        (the synths), every other source fills its own bus each block.
+        Every source has a gain and a pan (balance, -1 left .. 1 right),
+        which may be set from any thread and are ramped over the next
+        block so changes don't click.
+
+        int clip = mixer.add(0.8);                // onInit(), before audio starts
+        mixer.prepare(io.framesPerBuffer());
+
+        // onSound(), after the synths render
+        mixer.enable(clip, playing);              // flags are read once per block
+        if (mixer.enabled(clip)) stream.read(mixer.left(clip), mixer.right(clip), frames);
+        mixer.mix(io.outBuffer(0), io.outBuffer(1), frames);
+
+    A source that is enabled must fill every frame of both of its buses.
+*/
+class Mixer {
+    public:
+        const static int maxSources = 8;
+        const static int direct = 0; // the synths, already in the output
+
+        // adds a source, returns its index
+        int add(float gain = 1, float pan = 0, bool enabled = true){
+            if(mCount == maxSources) throw std::out_of_range("Mixer : too many sources");
+            int i = mCount++;
+            this->gain(i, gain);
+            this->pan(i, pan);
+            enable(i, enabled);
+            return i;
+        }
+
+        // sizes the source buses (only allocates when the block size changes)
+        void prepare(int frames){
+            for(int i=1; i<mCount; i++){
+                mSources[i].left.prepare(frames);
+                mSources[i].right.prepare(frames);
+            }
+        }
+
+        void gain(int source, float gain){ mSources[source].gain.store(gain, std::memory_order_relaxed); }
+        void pan(int source, float pan){ mSources[source].pan.store(pan, std::memory_order_relaxed); }
+        void enable(int source, bool enabled){ mSources[source].enabled.store(enabled, std::memory_order_relaxed); }
+
+        float gain(int source) const { return mSources[source].gain.load(std::memory_order_relaxed); }
+        float pan(int source) const { return mSources[source].pan.load(std::memory_order_relaxed); }
+        bool enabled(int source) const { return mSources[source].enabled.load(std::memory_order_relaxed); }
+
+        float* left(int source){ return mSources[source].left.data(); }
+        float* right(int source){ return mSources[source].right.data(); }
+        int sources() const { return mCount; }
+
+        // audio thread: applies the direct source's gain to out, then adds every enabled source
+        void mix(float* outL, float* outR, int frames){
+            for(int i=0; i<mCount; i++){
+                source& s = mSources[i];
+                float toL, toR;
+                // a source starts at its set gain, it only ramps while it plays
+                if(!s.enabled.load(std::memory_order_relaxed)){
+                    s.fresh = true;
+                    if(i == direct){
+                        clearBlock(outL, frames);
+                        clearBlock(outR, frames);
+                    }
+                    continue;
+                }
+                balance(s, toL, toR);
+                if(s.fresh){
+                    s.lastL = toL;
+                    s.lastR = toR;
+                    s.fresh = false;
+                }
+
+                if(i == direct){
+                    scaleRamp(outL, frames, s.lastL, toL);
+                    scaleRamp(outR, frames, s.lastR, toR);
+                }
+                else{
+                    mixRamp(outL, s.left.data(), frames, s.lastL, toL);
+                    mixRamp(outR, s.right.data(), frames, s.lastR, toR);
+                }
+                s.lastL = toL;
+                s.lastR = toR;
+            }
+        }
+
+    private:
+        struct source {
+            std::atomic<float> gain{1};
+            std::atomic<float> pan{0};
+            std::atomic<bool> enabled{true};
+            float lastL = 1, lastR = 1; // gains applied at the end of the last block
+            bool fresh = true;          // no block mixed yet since enabled
+            AuxBus left, right;
+        };
+
+        // left/right gains of a stereo source at its gain and pan
+        static void balance(const source& s, float& gainL, float& gainR){
+            float gain = s.gain.load(std::memory_order_relaxed);
+            float pan = s.pan.load(std::memory_order_relaxed);
+            gainL = pan > 0 ? gain * (1 - pan) : gain;
+            gainR = pan < 0 ? gain * (1 + pan) : gain;
+        }
+
+        // out[i] += in[i] * gain, gain going linearly from -> to over the block
+        static void mixRamp(float* out, const float* in, int frames, float from, float to){
+            if(from == to){
+                for(int i=0; i<frames; i++) out[i] += in[i] * to;
+                return;
+            }
+            float step = (to - from) / frames;
+            for(int i=0; i<frames; i++) out[i] += in[i] * (from + step * i);
+        }
+
+        // buffer[i] *= gain, gain going linearly from -> to over the block
+        static void scaleRamp(float* buffer, int frames, float from, float to){
+            if(from == to){
+                if(to == 1) return;
+                for(int i=0; i<frames; i++) buffer[i] *= to;
+                return;
+            }
+            float step = (to - from) / frames;
+            for(int i=0; i<frames; i++) buffer[i] *= from + step * i;
+        }
+
+        static void clearBlock(float* buffer, int frames){
+            for(int i=0; i<frames; i++) buffer[i] = 0;
+        }
+
+        source mSources[maxSources];
+        int mCount = 1; // source 0 is always there
+};
+
+}
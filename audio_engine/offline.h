@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "al/io/al_AudioIOData.hpp"
+
+#include "wavwriter.h"
+
+namespace engine {
+
+struct render_stats {
+    int64_t frames = 0;
+    double audioSeconds = 0;
+    double wallSeconds = 0;
+
+    // seconds of audio rendered per second of wall time
+    double realtimeFactor() const { return wallSeconds > 0 ? audioSeconds / wallSeconds : 0; }
+};
+
+// calls block(io, frames), returns false if it asked to stop (a block returning void never does)
+template <class Block>
+bool runBlock(Block& block, al::AudioIOData& io, int frames)
+{
+    if constexpr(std::is_same<decltype(block(io, frames)), bool>::value) return block(io, frames);
+    else {
+        block(io, frames);
+        return true;
+    }
+}
+
+/*
+    renderBlocks: runs an audio callback on a synthetic AudioIOData as fast
+    as the cpu allows (no audio device), calling block(io, frames) after each
+
+        engine::renderBlocks(10, [&](AudioIOData& io){ onSound(io); }, [](AudioIOData&, int){});
+
+    Each block is cleared before the callback, like a live AudioIO. A
+    block() returning bool can end the render early by returning false.
+*/
+template <class Callback, class Block>
+render_stats renderBlocks(double seconds, Callback&& onSound, Block&& block,
+                          double sampleRate=48000, int framesPerBuffer=512, int channels=2)
+{
+    al::AudioIOData io;
+    io.framesPerSecond(sampleRate);
+    io.framesPerBuffer(framesPerBuffer);
+    io.channelsIn(0);
+    io.channelsOut(channels);
+
+    int64_t total = (int64_t)std::llround(seconds * sampleRate);
+
+    auto start = std::chrono::steady_clock::now();
+    int64_t done = 0;
+    while(done < total){
+        io.zeroOut();
+        io.frame(0);
+        onSound(io);
+        int frames = (int)std::min<int64_t>(framesPerBuffer, total-done);
+        done += frames;
+        if(!runBlock(block, io, frames)) break;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    render_stats stats;
+    stats.frames = done;
+    stats.audioSeconds = done / sampleRate;
+    stats.wallSeconds = std::chrono::duration<double>(end - start).count();
+    return stats;
+}
+
+/*
+    renderOffline: renderBlocks() streamed to a wav file
+
+        engine::renderOffline("out.wav", 60, [&](AudioIOData& io){ onSound(io); });
+*/
+template <class Callback>
+render_stats renderOffline(const std::string& path, double seconds, Callback&& onSound,
+                           double sampleRate=48000, int framesPerBuffer=512, int channels=2)
+{
+    WavWriter wav;
+    if(!wav.open(path, sampleRate, channels)){
+        throw std::runtime_error("renderOffline : could not open ("+path+") for writing");
+    }
+
+    std::vector<float> interleaved(framesPerBuffer * channels);
+    render_stats stats = renderBlocks(seconds, onSound, [&](al::AudioIOData& io, int frames) {
+        for(int c=0; c<channels; c++){
+            const float* buf = io.outBuffer(c);
+            for(int i=0; i<frames; i++) interleaved[i*channels + c] = buf[i];
+        }
+        wav.write(interleaved.data(), frames);
+    }, sampleRate, framesPerBuffer, channels);
+    wav.close();
+    return stats;
+}
+
+// one chunk of a renderChunked() session, in frames from the start
+struct chunk_span {
+    int index;
+    int64_t start;  // events starting in [start, end) belong to this chunk
+    int64_t end;
+    int64_t stop;   // rendered until here at most, so its last notes ring out over the next chunks
+};
+
+/*
+    renderChunked: renderOffline() of a long session cut in time, the
+    chunks rendered on worker threads
+
+        The session is cut into block-aligned chunks of chunkSeconds. For
+        each one, makeChunk(chunk) is called on this thread and returns the
+        job rendering it, which one of workers threads runs as job(stems).
+        A job renders from time 0 but only starts the events inside
+        [chunk.start, chunk.end), and writes its stems from chunk.start up
+        to chunk.stop, tailSeconds past end: block after block, each
+        stemChannels channels of framesPerBuffer floats, one channel after
+        the other. stems starts zeroed, so a job can stop once its notes
+        are done. For each block of the session the stems of the chunks
+        covering it are summed in chunk order, then mix(stems, io) turns
+        them into io (cleared first), which is written to path.
+
+        engine::renderChunked("out.wav", 600, 15, 4, 8, 7,
+            [&](const engine::chunk_span& chunk) {
+                auto kit = std::make_unique<Kit>();  // made here, the job's own
+                ...init it, play the session...
+                return [kit = std::move(kit), chunk](float* stems) { ...render, copy from chunk.start... };
+            },
+            [&](const float* stems, AudioIOData& io) {
+                ...the end of onSound(), from the summed stems...
+            });
+
+    Chunks are summed and mixed in the same order whatever the number of
+    workers, so the file is bit for bit the same for any. Against the
+    serial render it differs by float rounding where chunks overlap, and
+    where a chunk's first notes would have met the previous chunk's on a
+    voice (stealing), so voices must start a note from the same state
+    whatever they played before. Anything that has to hear the whole
+    session, like a reverb, belongs in mix(). Notes ringing past
+    tailSeconds are cut. Jobs are made and destroyed on this thread, so
+    what registers itself with globals (Gamma's domains) does it here;
+    while rendering, jobs may only read globals. Only a few chunks are
+    held at a time, so memory does not grow with the session.
+*/
+template <class MakeChunk, class Mix>
+render_stats renderChunked(const std::string& path, double seconds, double chunkSeconds,
+                           double tailSeconds, int workers, int stemChannels,
+                           MakeChunk&& makeChunk, Mix&& mix,
+                           double sampleRate=48000, int framesPerBuffer=512, int channels=2)
+{
+    int64_t total = (int64_t)std::llround(seconds * sampleRate);
+    int64_t chunkFrames = std::max<int64_t>(std::llround(chunkSeconds * sampleRate / framesPerBuffer), 1) * framesPerBuffer;
+    int64_t tailFrames = std::max<int64_t>(std::llround(tailSeconds * sampleRate), 0);
+    workers = std::max(workers, 1);
+
+    std::vector<chunk_span> chunks;
+    for(int64_t start=0; start<total; start+=chunkFrames){
+        chunk_span c;
+        c.index = (int)chunks.size();
+        c.start = start;
+        c.end = std::min(start + chunkFrames, total);
+        c.stop = std::min(c.end + tailFrames, total);
+        chunks.push_back(c);
+    }
+
+    WavWriter wav;
+    if(!wav.open(path, sampleRate, channels)){
+        throw std::runtime_error("renderChunked : could not open ("+path+") for writing");
+    }
+
+    // a chunk is made here, rendered by a worker, summed here and freed here
+    using Job = typename std::decay<decltype(makeChunk(std::declval<const chunk_span&>()))>::type;
+    struct chunk_state {
+        std::unique_ptr<Job> job;
+        std::vector<float> stems;
+        bool done = false;
+    };
+    std::vector<chunk_state> state(chunks.size());
+    size_t blockFloats = (size_t)stemChannels * framesPerBuffer;
+
+    std::mutex lock; // guards the queue, done and error
+    std::condition_variable ready, finished;
+    std::deque<size_t> queue;
+    bool quit = false;
+    std::exception_ptr error;
+
+    auto worker = [&] {
+        for(;;){
+            size_t c;
+            {
+                std::unique_lock<std::mutex> hold(lock);
+                ready.wait(hold, [&] { return quit || !queue.empty(); });
+                if(quit) return;
+                c = queue.front();
+                queue.pop_front();
+            }
+            std::exception_ptr failed;
+            try { (*state[c].job)(state[c].stems.data()); }
+            catch(...) { failed = std::current_exception(); }
+            std::lock_guard<std::mutex> hold(lock);
+            state[c].done = true;
+            if(failed && !error) error = failed;
+            finished.notify_one();
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    std::exception_ptr failure;
+    try {
+        for(int t=0; t<workers; t++) threads.emplace_back(worker);
+
+        al::AudioIOData io;
+        io.framesPerSecond(sampleRate);
+        io.framesPerBuffer(framesPerBuffer);
+        io.channelsIn(0);
+        io.channelsOut(channels);
+
+        std::vector<float> stems(blockFloats);
+        std::vector<float> interleaved(framesPerBuffer * channels);
+
+        // enough chunks in flight to keep every worker busy past the tails
+        size_t ahead = workers + (size_t)((tailFrames + chunkFrames - 1) / chunkFrames);
+        size_t first = 0; // chunks before it are freed
+        size_t next = 0;  // chunks before it are made
+        for(int64_t done=0; done<total; done+=framesPerBuffer){
+            while(first < next && chunks[first].stop <= done){
+                state[first] = chunk_state();
+                first++;
+            }
+            size_t current = (size_t)(done / chunkFrames);
+            while(next < chunks.size() && (next <= current || next < first + ahead)){
+                const chunk_span& c = chunks[next];
+                state[next].job.reset(new Job(makeChunk(c)));
+                state[next].stems.assign((size_t)((c.stop - c.start + framesPerBuffer - 1) / framesPerBuffer) * blockFloats, 0.0f);
+                {
+                    std::lock_guard<std::mutex> hold(lock);
+                    queue.push_back(next);
+                }
+                ready.notify_one();
+                next++;
+            }
+
+            // every frame is the sum of the chunks covering it, in chunk order;
+            // the first one is copied so a lone chunk's output (and its -0s) is untouched
+            bool copied = false;
+            for(size_t c=first; c<next && chunks[c].start<=done; c++){
+                if(chunks[c].stop <= done) continue;
+                {
+                    std::unique_lock<std::mutex> hold(lock);
+                    finished.wait(hold, [&] { return state[c].done || error; });
+                    if(error) std::rethrow_exception(error);
+                }
+                const float* src = state[c].stems.data() + (size_t)((done - chunks[c].start) / framesPerBuffer) * blockFloats;
+                if(copied) for(size_t i=0; i<blockFloats; i++) stems[i] += src[i];
+                else std::copy(src, src + blockFloats, stems.begin());
+                copied = true;
+            }
+
+            io.zeroOut();
+            io.frame(0);
+            mix((const float*)stems.data(), io);
+            int frames = (int)std::min<int64_t>(framesPerBuffer, total - done);
+            for(int c=0; c<channels; c++){
+                const float* buf = io.outBuffer(c);
+                for(int i=0; i<frames; i++) interleaved[i*channels + c] = buf[i];
+            }
+            wav.write(interleaved.data(), frames);
+        }
+    }
+    catch(...) { failure = std::current_exception(); }
+
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        quit = true;
+    }
+    ready.notify_all();
+    for(std::thread& t : threads) t.join();
+    state.clear(); // the jobs left, freed on this thread
+    wav.close();
+    if(failure) std::rethrow_exception(failure);
+    auto end = std::chrono::steady_clock::now();
+
+    render_stats stats;
+    stats.frames = total;
+    stats.audioSeconds = total / sampleRate;
+    stats.wallSeconds = std::chrono::duration<double>(end - start).count();
+    return stats;
+}
+
+}
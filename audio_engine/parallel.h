@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "al/io/al_AudioIOData.hpp"
+#include "al/scene/al_PolySynth.hpp"
+
+#include "rtguard.h"
+#include "voices.h"
+
+namespace engine {
+
+/*
+    ParallelRender: renders a PolySynth's active voices on several threads
+
+        Instead of synth.render(io), the active voices are cut into batches
+        of consecutive voices, each batch rendered into its own stereo
+        buffer, and the batch buffers summed into io with a pairwise tree.
+        The audio thread takes part, worker threads help with whatever is
+        left, and a worker that runs out steals from the others.
+
+        renderer.prepare(64, 4, io.framesPerBuffer());     // onInit(), starts the workers
+        renderer.threads(2);                              // any thread, 1 to prepare()'s count
+        renderer.render(synthManager.synth(), io);        // onSound(), instead of synthManager.render(io)
+        renderer.render(pool.voices(), io);               // or a VoicePool's voices, then pool.update()
+
+    Output depends only on the voices and the batch size, not on the
+    thread count or on who rendered which batch: the sum order is fixed.
+    It differs from synth.render() by float rounding, since that adds
+    every voice straight into io.
+
+    The audio thread never waits for a sleeping worker: it renders every
+    batch nobody took, and only waits for batches a worker is in the
+    middle of. After a round a worker spins for an eighth of a block, then
+    parks until the next one, so idle workers don't burn a core between
+    blocks. On Linux it parks on a futex on the round counter: render()
+    wakes it without taking a lock (only when somebody is parked), and the
+    kernel checks the counter before sleeping, so no wakeup is lost.
+    Elsewhere a parked worker sleeps an eighth of a block at a time.
+
+    Voices must not write shared state from onProcess() (a DrumKit's
+    snares all add to its reverbSend, so a kit renders serially).
+    Sequencer events are not run, trigger voices on the synth directly or
+    render a VoicePool's voices().
+*/
+class ParallelRender {
+    public:
+        constexpr static int maxThreads = 16;
+        constexpr static int reduceChunk = 64; // frames per summing job
+
+        ~ParallelRender(){ stop(); }
+
+        // sizes the batches and starts threads - 1 workers (the audio thread is the other one),
+        // voices past maxVoices still render, on the audio thread after the others
+        void prepare(int maxVoices, int threads, int framesPerBuffer, int voicesPerBatch = 8){
+            stop();
+            mBatchVoices = std::max(voicesPerBatch, 1);
+            mVoices.assign(std::max(maxVoices, 1), nullptr);
+            mBatches.clear();
+            mBatches.resize((mVoices.size() + mBatchVoices - 1) / mBatchVoices);
+            mFrames = -1;
+            shape(framesPerBuffer, 48000);
+
+            mWorkers = std::min(std::max(threads, 1), maxThreads) - 1;
+            mThreads.store(mWorkers + 1, std::memory_order_relaxed);
+            mStop.store(false);
+            for(int i=1; i<=mWorkers; i++) mPool.emplace_back([this, i]{ worker(i); });
+        }
+
+        void stop(){
+            mStop.store(true);
+            mRound.fetch_add(1, std::memory_order_seq_cst); // a worker about to park won't
+            wakeAll();
+            for(std::thread& t : mPool) t.join();
+            mPool.clear();
+            mWorkers = 0;
+        }
+
+        // threads rendering from now on, audio thread included (clamped to 1 .. prepare()'s count)
+        void threads(int n){ mThreads.store(std::min(std::max(n, 1), mWorkers + 1), std::memory_order_relaxed); }
+        int threads() const { return mThreads.load(std::memory_order_relaxed); }
+        int maxPrepared() const { return mWorkers + 1; }
+
+        // voices rendered after the others because there were more than prepare()'s maxVoices
+        long overflows() const { return mOverflows.load(std::memory_order_relaxed); }
+
+        // audio thread, in place of synth.render(io) (adds into io)
+        void render(al::PolySynth& synth, al::AudioIOData& io){
+            shape(io.framesPerBuffer(), io.framesPerSecond());
+
+            // zero frames: the synth starts queued voices and retires finished ones
+            synth.render(mIdle);
+            render(synth.getActiveVoices(), io);
+        }
+
+        // audio thread, renders the voices linked from first through SynthVoice::next (adds into io)
+        void render(al::SynthVoice* first, al::AudioIOData& io){
+            int frames = io.framesPerBuffer();
+            shape(frames, io.framesPerSecond()); // only allocates when the block size changes
+
+            int count = 0, extra = 0;
+            for(al::SynthVoice* v = first; v; v = v->next){
+                if(count < (int)mVoices.size()) mVoices[count++] = v;
+                else extra++;
+            }
+            mCount = count;
+            int batches = (count + mBatchVoices - 1) / mBatchVoices;
+            mUsed = batches;
+            mOut = &io;
+
+            if(batches > 1){
+                run(job_batch, batches);
+                run(job_reduce, (frames + reduceChunk - 1) / reduceChunk);
+            }
+            else if(batches == 1){
+                renderBatch(0);
+                for(int c=0; c<2; c++){
+                    float* out = io.outBuffer(c);
+                    const float* in = mBatches[0].io->outBuffer(c);
+                    for(int i=0; i<frames; i++) out[i] += in[i];
+                }
+            }
+
+            if(extra > 0){
+                mOverflows.fetch_add(extra, std::memory_order_relaxed);
+                int n = 0;
+                for(al::SynthVoice* v = first; v; v = v->next){
+                    if(n++ >= count) renderVoice(v, io);
+                }
+            }
+        }
+
+    private:
+        enum job_kind { job_batch, job_reduce };
+
+        struct batch {
+            std::unique_ptr<al::AudioIOData> io;
+        };
+
+        // a participant's jobs, [begin, end) packed as begin << 32 | end
+        struct alignas(64) job_range {
+            std::atomic<uint64_t> jobs{0};
+        };
+
+        static uint64_t pack(uint32_t begin, uint32_t end){ return (uint64_t)begin << 32 | end; }
+
+        // resizes the batch buffers if the block size or rate changed
+        void shape(int frames, double sampleRate){
+            if(frames == mFrames && sampleRate == mRate) return;
+            mFrames = frames;
+            mRate = sampleRate;
+            for(batch& b : mBatches){
+                if(!b.io) b.io.reset(new al::AudioIOData());
+                b.io->framesPerSecond(sampleRate);
+                b.io->framesPerBuffer(frames);
+                b.io->channelsIn(0);
+                b.io->channelsOut(2);
+            }
+            int64_t blockNs = (int64_t)(frames / sampleRate * 1e9);
+            mSpinNs.store(blockNs / 8, std::memory_order_relaxed);
+            mIdle.framesPerSecond(sampleRate);
+            mIdle.framesPerBuffer(0);
+            mIdle.channelsIn(0);
+            mIdle.channelsOut(2);
+        }
+
+        void renderBatch(int b){
+            al::AudioIOData& io = *mBatches[b].io;
+            io.zeroOut();
+            int end = std::min((b + 1) * mBatchVoices, mCount);
+            for(int i = b * mBatchVoices; i < end; i++) renderVoice(mVoices[i], io);
+        }
+
+        // sums every batch into io over one chunk of frames, pairs first then pairs of pairs
+        void reduce(int chunk){
+            int start = chunk * reduceChunk;
+            int stop = std::min(start + reduceChunk, mFrames);
+            for(int c=0; c<2; c++){
+                for(int stride=1; stride<mUsed; stride*=2){
+                    for(int b=0; b+stride<mUsed; b+=2*stride){
+                        float* into = mBatches[b].io->outBuffer(c);
+                        const float* from = mBatches[b + stride].io->outBuffer(c);
+                        for(int i=start; i<stop; i++) into[i] += from[i];
+                    }
+                }
+                float* out = mOut->outBuffer(c);
+                const float* sum = mBatches[0].io->outBuffer(c);
+                for(int i=start; i<stop; i++) out[i] += sum[i];
+            }
+        }
+
+        void execute(int job){
+            if(mKind == job_batch) renderBatch(job);
+            else reduce(job);
+            mDone.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        // takes the next job of participant p, from the front
+        bool take(int p, int& job){
+            uint64_t v = mRanges[p].jobs.load(std::memory_order_acquire);
+            for(;;){
+                uint32_t begin = v >> 32, end = (uint32_t)v;
+                if(begin >= end) return false;
+                if(mRanges[p].jobs.compare_exchange_weak(v, pack(begin + 1, end), std::memory_order_acq_rel, std::memory_order_acquire)){
+                    job = begin;
+                    return true;
+                }
+            }
+        }
+
+        // takes the last job of participant p, from the back
+        bool steal(int p, int& job){
+            uint64_t v = mRanges[p].jobs.load(std::memory_order_acquire);
+            for(;;){
+                uint32_t begin = v >> 32, end = (uint32_t)v;
+                if(begin >= end) return false;
+                if(mRanges[p].jobs.compare_exchange_weak(v, pack(begin, end - 1), std::memory_order_acq_rel, std::memory_order_acquire)){
+                    job = end - 1;
+                    return true;
+                }
+            }
+        }
+
+        // runs own jobs, then steals until every range is empty
+        void work(int p){
+            int job;
+            while(take(p, job)) execute(job);
+            bool found = true;
+            while(found){
+                found = false;
+                for(int k=1; k<maxThreads; k++){
+                    if(steal((p + k) % maxThreads, job)){
+                        execute(job);
+                        found = true;
+                    }
+                }
+            }
+        }
+
+        // audio thread: splits jobs over the participants, works, waits for the stragglers
+        void run(job_kind kind, int jobs){
+            int participants = threads();
+            mKind = kind;
+            mDone.store(0, std::memory_order_relaxed);
+            for(int p=0; p<maxThreads; p++){
+                uint32_t begin = p < participants ? (uint32_t)((int64_t)jobs * p / participants) : 0;
+                uint32_t end = p < participants ? (uint32_t)((int64_t)jobs * (p + 1) / participants) : 0;
+                mRanges[p].jobs.store(pack(begin, end), std::memory_order_release);
+            }
+            // pairs with park(): either we see the sleeper or its futex sees the round
+            mRound.fetch_add(1, std::memory_order_seq_cst);
+            if(mSleepers.load(std::memory_order_seq_cst) > 0) wakeAll();
+
+            // every job left in any range is ours after this, so we only
+            // wait for jobs a worker is running right now
+            work(0);
+            while(mDone.load(std::memory_order_acquire) < jobs) std::this_thread::yield();
+        }
+
+        void worker(int index){
+            uint32_t seen = mRound.load(std::memory_order_acquire);
+            auto idleSince = std::chrono::steady_clock::now();
+            while(!mStop.load(std::memory_order_relaxed)){
+                uint32_t round = mRound.load(std::memory_order_acquire);
+                if(round != seen){
+                    seen = round;
+                    if(index >= threads()) continue;
+                    RtScope rt; // voices render here too
+                    work(index);
+                    idleSince = std::chrono::steady_clock::now();
+                    continue;
+                }
+                // the reduce round follows the batch round at once, the next block
+                // is a whole block away: spin through a little, then sleep
+                auto spin = std::chrono::nanoseconds(mSpinNs.load(std::memory_order_relaxed));
+                if(std::chrono::steady_clock::now() - idleSince < spin) std::this_thread::yield();
+                else park(seen);
+            }
+        }
+
+        // sleeps until render() starts a round after seen
+        void park(uint32_t seen){
+#ifdef __linux__
+            mSleepers.fetch_add(1, std::memory_order_seq_cst);
+            // returns at once if the round already moved on (or on a signal, the loop parks again)
+            syscall(SYS_futex, roundWord(), FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+            mSleepers.fetch_sub(1, std::memory_order_relaxed);
+#else
+            (void)seen;
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::max<int64_t>(mSpinNs.load(std::memory_order_relaxed), 100000)));
+#endif
+        }
+
+        // wakes every parked worker, no lock taken
+        void wakeAll(){
+#ifdef __linux__
+            syscall(SYS_futex, roundWord(), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+        }
+
+#ifdef __linux__
+        uint32_t* roundWord(){ return reinterpret_cast<uint32_t*>(&mRound); }
+#endif
+
+        // set up by the audio thread before each round, read by workers after they took a job
+        std::vector<al::SynthVoice*> mVoices;
+        std::vector<batch> mBatches;
+        int mBatchVoices = 8;
+        int mCount = 0;
+        int mUsed = 0;
+        int mFrames = -1;
+        double mRate = 0;
+        job_kind mKind = job_batch;
+        al::AudioIOData* mOut = nullptr;
+        al::AudioIOData mIdle;
+
+        job_range mRanges[maxThreads];
+        std::atomic<uint32_t> mRound{0};   // rounds started, the parked workers' futex word
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+                      "the round counter is waited on as a plain 32 bit futex word");
+        std::atomic<int> mDone{0};
+        std::atomic<int> mThreads{1};
+        std::atomic<bool> mStop{false};
+        std::atomic<long> mOverflows{0};
+
+        // parked workers, woken by run()
+        std::atomic<int> mSleepers{0};
+        std::atomic<int64_t> mSpinNs{0};   // spin after a round, an eighth of a block
+
+        std::vector<std::thread> mPool;
+        int mWorkers = 0;
+};
+
+}
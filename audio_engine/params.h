@@ -0,0 +1,64 @@
+#pragma once
+
+#include "al/ui/al_Parameter.hpp"
+
+namespace engine {
+
+/*
+    SmoothedParameter: direct handle to a voice parameter, read once per block
+
+        Keep the Parameter& returned by createInternalTriggerParameter() in
+        init() and read it through this instead of getInternalParameterValue().
+        A change made during a block is ramped linearly over the next block.
+
+        mAmp.bind(createInternalTriggerParameter("amplitude", 0.3, 0.0, 1.0));
+        mAmp.snap();                         // onTriggerOn(), no ramp from the last note
+        mAmp.beginBlock(io.framesPerBuffer());
+        while (io()) { float a = mAmp.next(); ... }
+*/
+class SmoothedParameter {
+    public:
+        void bind(al::Parameter& param){
+            mParam = &param;
+            snap();
+        }
+
+        // jump straight to the current value
+        void snap(){
+            mCurrent = mTarget = mParam->get();
+            mRemaining = 0;
+        }
+
+        // reads the parameter and ramps to it over frames samples
+        void beginBlock(int frames){
+            mTarget = mParam->get();
+            if(mTarget == mCurrent || frames <= 0){
+                mCurrent = mTarget;
+                mRemaining = 0;
+                return;
+            }
+            mStep = (mTarget - mCurrent) / frames;
+            mRemaining = frames;
+        }
+
+        // returns next per-sample value
+        float next(){
+            if(mRemaining > 0){
+                mRemaining--;
+                mCurrent = mRemaining ? mCurrent + mStep : mTarget;
+            }
+            return mCurrent;
+        }
+
+        float target() const { return mTarget; }
+        al::Parameter& parameter(){ return *mParam; }
+
+    private:
+        al::Parameter* mParam = nullptr;
+        float mCurrent = 0;
+        float mTarget = 0;
+        float mStep = 0;
+        int mRemaining = 0;
+};
+
+}
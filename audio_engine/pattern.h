@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include "queue.h"
+#include "timeline.h"
+#include "voices.h"
+
+namespace engine {
+
+/*
+    StepPattern: drum groove as one bitmask row per instrument
+
+        Each row has a bit per step (up to 64 steps, e.g. 4 bars of 16ths)
+        and a velocity lane. Rows are written as strings, one char per step:
+        '.' or '-' rest, 'x' full velocity, '1'..'9' softer hits.
+        Spaces and '|' are ignored, use them to mark beats and bars.
+
+        engine::StepPattern house(140);           // 4/4, 16th note steps, 1 bar
+        house.row(kick,  "x... .... ..x. ..x.", 100, 0.9, 0.4);
+        house.row(snare, ".... x... .... x...");
+        house.row(hihat, "..x. ..x. ..x. ..x.");
+*/
+
+const static int maxPatternRows = 8;
+const static int maxPatternSteps = 64;
+
+struct pattern_row {
+    int instrument;  // app defined, e.g. an enum of voice types
+    float pitch;     // passed to the voice, 0 if unused
+    float gain;      // amplitude of a full velocity hit
+    float duration;  // seconds until note off
+    uint64_t hits;   // bit i set = hit on step i
+    uint8_t velocity[maxPatternSteps]; // 0..127
+};
+
+// one note to start, velocity already applied to amp
+struct drum_hit {
+    int instrument;
+    float pitch;
+    float amp;
+    float duration;
+};
+
+class StepPattern {
+    public:
+        explicit StepPattern(float bpm = 120, int bars = 1, int stepsPerBeat = 4, int beatsPerBar = 4)
+            : mBpm(bpm), mStepsPerBeat(stepsPerBeat), mStepsPerBar(stepsPerBeat * beatsPerBar), mBars(bars){
+            if(steps() > maxPatternSteps || steps() <= 0)
+                throw std::out_of_range("StepPattern : pattern needs 1 to 64 steps");
+        }
+
+        // adds an instrument row, steps holds one char per step (see above)
+        StepPattern& row(int instrument, const char* steps, float pitch = 0, float gain = 1, float duration = 0.3){
+            if(mRowCount == maxPatternRows) throw std::out_of_range("StepPattern : too many rows");
+
+            pattern_row& r = mRows[mRowCount];
+            r = pattern_row{instrument, pitch, gain, duration, 0, {}};
+            int step = 0;
+            for(const char* c = steps; *c; c++){
+                if(*c == ' ' || *c == '|') continue;
+                if(step == this->steps()) throw std::out_of_range("StepPattern : too many steps in row");
+
+                int velocity = 0;
+                if(*c == 'x' || *c == 'X') velocity = 127;
+                else if(*c >= '1' && *c <= '9') velocity = (*c - '0') * 127 / 9;
+                else if(*c != '.' && *c != '-') throw std::out_of_range("StepPattern : Invalid step");
+
+                if(velocity) r.hits |= uint64_t(1) << step;
+                r.velocity[step++] = velocity;
+            }
+            mRowCount++;
+            return *this;
+        }
+
+        // returns the note for row on step
+        drum_hit hit(int row, int step) const {
+            const pattern_row& r = mRows[row];
+            return drum_hit{r.instrument, r.pitch, r.gain * r.velocity[step] / 127.0f, r.duration};
+        }
+
+        bool isHit(int row, int step) const { return (mRows[row].hits >> step) & 1; }
+
+        // returns length of a step in frames (not rounded)
+        double stepFrames(double sampleRate) const { return sampleRate * 60.0 / (mBpm * mStepsPerBeat); }
+
+        float bpm() const { return mBpm; }
+        int rows() const { return mRowCount; }
+        int stepsPerBar() const { return mStepsPerBar; }
+        int bars() const { return mBars; }
+        int steps() const { return mStepsPerBar * mBars; }
+
+    private:
+        float mBpm;
+        int mStepsPerBeat;
+        int mStepsPerBar;
+        int mBars;
+        int mRowCount = 0;
+        pattern_row mRows[maxPatternRows];
+};
+
+/*
+    PatternPlayer: plays StepPatterns (and single hits) on the audio thread
+
+        Each playing pattern expands only its next bar into a fixed event
+        buffer, so looping a groove for hours uses no more memory than one
+        bar. Hits start, and are released, at their exact frame inside the block.
+
+        player.play(groove, 0);                    // GUI thread, 0 = loop forever
+        player.hit({kick, 100, 0.9, 0.4});
+
+        // onSound(), before the synth renders
+        player.process(io.framesPerBuffer(),
+            [&](const engine::drum_hit& hit, int offset) { return engine::note_ref{voice, id}; },
+            [&](const engine::note_ref& note, int offset) { engine::releaseNote(note, offset); });
+
+    play()/hit()/stop() go through a wait-free queue, so they must all be
+    called from the same (UI) thread.
+*/
+class PatternPlayer {
+    public:
+        const static int maxPlays = 8;      // patterns playing at once
+        const static int maxRequests = 32;  // requests waiting for the audio thread
+        const static int maxNotes = 256;    // notes waiting for their note off
+
+        void sampleRate(double sampleRate){ mSampleRate = sampleRate; }
+
+        // plays pattern repeats times (0 = until stop()), pattern must outlive the play
+        void play(const StepPattern& pattern, int repeats = 1){
+            request r;
+            r.type = request_play;
+            r.pattern = &pattern;
+            r.repeats = repeats;
+            push(r);
+        }
+
+        // starts one note at the next block
+        void hit(const drum_hit& note){
+            request r;
+            r.type = request_hit;
+            r.note = note;
+            push(r);
+        }
+
+        // stops every pattern (notes already started ring out)
+        void stop(){
+            request r;
+            r.type = request_stop;
+            push(r);
+        }
+
+        // starts and stops notes in the next frames samples
+        // trigger(drum_hit, offset) returns the started note (voice nullptr if none),
+        // release(note_ref, offset) stops it
+        template<class Trigger, class Release>
+        void process(int frames, Trigger&& trigger, Release&& release){
+            int64_t blockEnd = mFrame + frames;
+            takeRequests(trigger);
+
+            for(int p=0; p<mPlayCount; ){
+                if(playBlock(mPlays[p], blockEnd, trigger)) p++;
+                else mPlays[p] = mPlays[--mPlayCount];
+            }
+
+            mNoteOffs.take(blockEnd, [&](const note_ref& note, int64_t frame) {
+                release(note, (int)std::max<int64_t>(frame - mFrame, 0));
+            });
+            mFrame = blockEnd;
+        }
+
+        int playing() const { return mPlayCount; }
+
+        // requests dropped because the audio thread fell behind
+        long requestOverflows() const { return mRequests.overflows(); }
+        // note offs dropped because too many notes were held
+        long noteOverflows() const { return mNoteOffs.overflows(); }
+
+    private:
+        enum { request_play, request_hit, request_stop };
+
+        struct request {
+            int type;
+            const StepPattern* pattern;
+            int repeats;
+            drum_hit note;
+        };
+
+        struct event {
+            int64_t frame;
+            int row;
+            int step;
+        };
+
+        struct play_state {
+            const StepPattern* pattern;
+            int repeats;        // 0 = forever
+            int64_t start;      // frame of step 0
+            int64_t nextStep;   // first step not expanded yet, counts across repeats
+            event events[maxPatternRows * maxPatternSteps];
+            int count;
+            int cursor;
+        };
+
+        void push(const request& r){ mRequests.push(r); }
+
+        template<class Trigger>
+        void takeRequests(Trigger& trigger){
+            request r;
+            while(mRequests.pop(r)){
+                if(r.type == request_stop) mPlayCount = 0;
+                else if(r.type == request_hit) start(r.note, mFrame, trigger);
+                else if(mPlayCount < maxPlays){
+                    play_state& p = mPlays[mPlayCount++];
+                    p.pattern = r.pattern;
+                    p.repeats = r.repeats;
+                    p.start = mFrame;
+                    p.nextStep = 0;
+                    p.count = p.cursor = 0;
+                }
+            }
+        }
+
+        // fills events with the next bar, returns false once the last repeat is done
+        bool expandBar(play_state& p){
+            const StepPattern& pattern = *p.pattern;
+            int64_t totalSteps = (int64_t)pattern.steps() * p.repeats;
+            if(p.repeats > 0 && p.nextStep >= totalSteps) return false;
+
+            p.count = p.cursor = 0;
+            for(int i=0; i<pattern.stepsPerBar(); i++){
+                int64_t absolute = p.nextStep + i;
+                int step = absolute % pattern.steps();
+                int64_t frame = stepFrame(p, absolute);
+                for(int row=0; row<pattern.rows(); row++){
+                    if(pattern.isHit(row, step)) p.events[p.count++] = event{frame, row, step};
+                }
+            }
+            p.nextStep += pattern.stepsPerBar();
+            return true;
+        }
+
+        // returns first frame of an absolute step
+        int64_t stepFrame(const play_state& p, int64_t step) const {
+            // from the absolute step, so long loops don't drift
+            return p.start + std::llround(step * p.pattern->stepFrames(mSampleRate));
+        }
+
+        // starts the play's events before blockEnd, returns false when finished
+        template<class Trigger>
+        bool playBlock(play_state& p, int64_t blockEnd, Trigger& trigger){
+            int stepsPerBar = p.pattern->stepsPerBar();
+            while(true){
+                if(p.cursor == p.count){
+                    // look one bar ahead, no further
+                    if(stepFrame(p, p.nextStep - stepsPerBar) >= blockEnd) return true;
+                    if(!expandBar(p)) return false;
+                    continue;
+                }
+
+                const event& e = p.events[p.cursor];
+                if(e.frame >= blockEnd) return true;
+                start(p.pattern->hit(e.row, e.step), e.frame, trigger);
+                p.cursor++;
+            }
+        }
+
+        template<class Trigger>
+        void start(const drum_hit& note, int64_t frame, Trigger& trigger){
+            int offset = (int)std::max<int64_t>(frame - mFrame, 0);
+            note_ref started = trigger(note, offset);
+            if(!started.voice) return;
+            // if this overflows the drum just ends on its own without a note off
+            mNoteOffs.add(frame + std::llround(note.duration * mSampleRate), started);
+        }
+
+        double mSampleRate = 48000;
+        int64_t mFrame = 0; // first frame of the current block
+
+        SpscQueue<request, maxRequests> mRequests;
+
+        play_state mPlays[maxPlays];
+        int mPlayCount = 0;
+
+        Timeline<note_ref, maxNotes> mNoteOffs; // started notes by note off frame
+};
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace engine {
+
+// copy of a BlockProfiler's counters, taken with snapshot()
+struct profile_snapshot {
+    const static int maxStages = 4;
+    const static int buckets = 64;
+    const static int bucketsPerOctave = 4;
+
+    long blocks = 0;
+    long misses = 0;            // blocks that took longer than the deadline
+    double deadlineNs = 0;      // one block period
+    double lowestNs = 0;        // lower edge of the first histogram bucket
+    double lastNs = 0;
+    double maxNs = 0;
+    double stageLastNs[maxStages] = {};
+    double stageMaxNs[maxStages] = {};
+    int voices = 0;             // active voices in the last block
+    int maxVoices = 0;
+    float histogram[buckets] = {}; // blocks per bucket, the last one holds everything slower
+
+    // upper edge (ns) of bucket i
+    double bucketEdge(int i) const { return lowestNs * std::exp2((i + 1) / (double)bucketsPerOctave); }
+
+    // block time (ns) that fraction of blocks stayed under, to bucket resolution
+    double percentile(double fraction) const {
+        long total = 0;
+        for(int i=0; i<buckets; i++) total += (long)histogram[i];
+        if(total == 0) return 0;
+        long target = (long)(fraction * total), seen = 0;
+        for(int i=0; i<buckets-1; i++){
+            seen += (long)histogram[i];
+            if(seen > target) return std::min(bucketEdge(i), maxNs);
+        }
+        return maxNs;
+    }
+};
+
+/*
+    BlockProfiler: how long each audio block takes against its deadline
+
+        The audio thread times each block and its stages with plain relaxed
+        atomic stores (no locks, no allocation). Any other thread can take a
+        snapshot() at any time, e.g. to draw it in ImGui or log it.
+
+        profiler.deadline(io.framesPerBuffer(), io.framesPerSecond());  // onInit()
+
+        profiler.beginBlock();                 // top of onSound()
+        synthManager.render(io);
+        profiler.endStage(0);                  // time since the last mark
+        ...mix...
+        profiler.endStage(1);
+        profiler.endBlock(voices.active());
+
+        engine::profile_snapshot s = profiler.snapshot();   // GUI thread
+
+    The histogram is logarithmic, a quarter octave per bucket, so it
+    resolves microsecond blocks as well as ones near the deadline. The
+    last bucket ends at two block periods and also holds anything slower.
+*/
+class BlockProfiler {
+    public:
+        const static int maxStages = profile_snapshot::maxStages;
+        const static int buckets = profile_snapshot::buckets;
+
+        void deadline(int frames, double sampleRate){
+            double ns = 1e9 * frames / sampleRate;
+            mDeadlineNs.store((int64_t)ns, std::memory_order_relaxed);
+        }
+
+        // audio thread
+        void beginBlock(){
+            mBlockStart = mMark = now();
+        }
+
+        // audio thread: time since beginBlock() or the last endStage() goes to stage
+        void endStage(int stage){
+            int64_t t = now();
+            int64_t ns = t - mMark;
+            mMark = t;
+            mStageLast[stage].store(ns, std::memory_order_relaxed);
+            storeMax(mStageMax[stage], ns);
+        }
+
+        // audio thread
+        void endBlock(int activeVoices){
+            int64_t ns = now() - mBlockStart;
+            int64_t deadline = mDeadlineNs.load(std::memory_order_relaxed);
+
+            int bucket = bucketOf(ns, deadline);
+            // only this thread writes, so a load and store is enough
+            mHistogram[bucket].store(mHistogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if(ns > deadline) mMisses.store(mMisses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            mLast.store(ns, std::memory_order_relaxed);
+            storeMax(mMax, ns);
+            mVoices.store(activeVoices, std::memory_order_relaxed);
+            if(activeVoices > mMaxVoices.load(std::memory_order_relaxed)) mMaxVoices.store(activeVoices, std::memory_order_relaxed);
+            mBlocks.store(mBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // any thread, counters may be a block apart from each other
+        profile_snapshot snapshot() const {
+            profile_snapshot s;
+            s.blocks = mBlocks.load(std::memory_order_relaxed);
+            s.misses = mMisses.load(std::memory_order_relaxed);
+            s.deadlineNs = (double)mDeadlineNs.load(std::memory_order_relaxed);
+            s.lowestNs = lowest((int64_t)s.deadlineNs);
+            s.lastNs = (double)mLast.load(std::memory_order_relaxed);
+            s.maxNs = (double)mMax.load(std::memory_order_relaxed);
+            for(int i=0; i<maxStages; i++){
+                s.stageLastNs[i] = (double)mStageLast[i].load(std::memory_order_relaxed);
+                s.stageMaxNs[i] = (double)mStageMax[i].load(std::memory_order_relaxed);
+            }
+            s.voices = mVoices.load(std::memory_order_relaxed);
+            s.maxVoices = mMaxVoices.load(std::memory_order_relaxed);
+            for(int i=0; i<buckets; i++) s.histogram[i] = (float)mHistogram[i].load(std::memory_order_relaxed);
+            return s;
+        }
+
+    private:
+        static int64_t now(){
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        const static int bucketsPerOctave = profile_snapshot::bucketsPerOctave;
+
+        // lower edge of the first bucket, so the last one ends at two deadlines
+        static double lowest(int64_t deadline){
+            return 2.0 * deadline / std::exp2(buckets / (double)bucketsPerOctave);
+        }
+
+        static int bucketOf(int64_t ns, int64_t deadline){
+            double octaves = std::log2(std::max<double>((double)ns, 1) / lowest(deadline));
+            int bucket = (int)std::floor(octaves * bucketsPerOctave);
+            return std::min(std::max(bucket, 0), buckets - 1);
+        }
+
+        static void storeMax(std::atomic<int64_t>& max, int64_t value){
+            if(value > max.load(std::memory_order_relaxed)) max.store(value, std::memory_order_relaxed);
+        }
+
+        int64_t mBlockStart = 0; // audio thread only
+        int64_t mMark = 0;
+
+        std::atomic<int64_t> mDeadlineNs{10666667}; // 512 frames at 48 kHz
+        std::atomic<long> mBlocks{0};
+        std::atomic<long> mMisses{0};
+        std::atomic<int64_t> mLast{0};
+        std::atomic<int64_t> mMax{0};
+        std::atomic<int64_t> mStageLast[maxStages] = {};
+        std::atomic<int64_t> mStageMax[maxStages] = {};
+        std::atomic<int> mVoices{0};
+        std::atomic<int> mMaxVoices{0};
+        std::atomic<long> mHistogram[buckets] = {};
+};
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace engine {
+
+/*
+    SpscQueue: wait-free ring buffer from one producer thread to one consumer
+
+        For handing trigger events from the UI thread to the audio thread
+        without locks. push() never blocks: when the ring is full the event
+        is dropped and counted in overflows().
+
+        engine::SpscQueue<note_event, 256> queue;
+        queue.push(event);                        // UI thread
+        while (queue.pop(event)) { ... }          // audio thread, block start
+
+    Capacity must be a power of 2.
+*/
+template<class T, int Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue : Capacity must be a power of 2");
+
+    public:
+        // producer only, returns false if the queue was full
+        bool push(const T& value){
+            size_t head = mHead.load(std::memory_order_relaxed);
+            if(head - mTailCache == Capacity){
+                // only reload the consumer's index when the cached one says full
+                mTailCache = mTail.load(std::memory_order_acquire);
+                if(head - mTailCache == Capacity){
+                    mOverflows.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            mItems[head & (Capacity - 1)] = value;
+            mHead.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer only, returns false if the queue was empty
+        bool pop(T& value){
+            size_t tail = mTail.load(std::memory_order_relaxed);
+            if(tail == mHeadCache){
+                mHeadCache = mHead.load(std::memory_order_acquire);
+                if(tail == mHeadCache) return false;
+            }
+            value = mItems[tail & (Capacity - 1)];
+            mTail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // returns number of queued events (approximate while the other side runs)
+        int size() const {
+            return (int)(mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire));
+        }
+
+        constexpr static int capacity(){ return Capacity; }
+
+        // returns number of events dropped because the queue was full
+        long overflows() const { return mOverflows.load(std::memory_order_relaxed); }
+
+    private:
+        // producer and consumer indices on separate cache lines
+        alignas(64) std::atomic<size_t> mHead{0};
+        size_t mTailCache = 0;
+        alignas(64) std::atomic<size_t> mTail{0};
+        size_t mHeadCache = 0;
+        alignas(64) std::atomic<long> mOverflows{0};
+        T mItems[Capacity];
+};
+
+}
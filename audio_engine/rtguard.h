@@ -0,0 +1,277 @@
+#pragma once
+
+#include <atomic>
+
+#ifdef ENGINE_RT_GUARD
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <streambuf>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace engine {
+
+/*
+    Real-time guard: catches allocations, locks and iostream output on the audio thread
+
+        Debug builds only. Compile with -DENGINE_RT_GUARD (and -rdynamic for
+        function names in the call stacks), otherwise everything below is a
+        no-op. While an RtScope is alive on a thread, every call to
+        operator new/delete (aligned and nothrow ones too), malloc/calloc/
+        realloc/free, aligned_alloc/posix_memalign/memalign,
+        pthread_mutex_lock and writes to std::cout/cerr/clog are counted,
+        and the first few are printed to stderr with their call stack.
+
+        engine::rtGuardInstall();              // main(), before audio starts
+
+        void onSound(AudioIOData& io) override {
+            engine::RtScope rt;                // covers every voice's onProcess() too
+            ...
+        }
+
+        engine::rt_violations v = engine::rtViolations();
+
+    The guard replaces the global allocation functions, so include it
+    with ENGINE_RT_GUARD in one translation unit only (the demos are one
+    file each). malloc and lock hooks need glibc.
+*/
+
+struct rt_violations {
+    long allocations = 0;
+    long locks = 0;
+    long iostream = 0;
+
+    long total() const { return allocations + locks + iostream; }
+};
+
+enum rt_kind { rt_allocation, rt_lock, rt_iostream };
+
+namespace rtguard {
+
+#ifdef ENGINE_RT_GUARD
+const static bool enabled = true;
+#else
+const static bool enabled = false;
+#endif
+
+inline thread_local int depth = 0;            // RtScopes alive on this thread
+inline thread_local bool reporting = false;   // inside report(), ignore our own calls
+inline std::atomic<long> counts[3] = {};
+inline std::atomic<int> reportsLeft{8};       // call stacks printed, then only counted
+inline std::atomic<bool> abortOnViolation{false};
+
+#ifdef ENGINE_RT_GUARD
+// prints what with the call stack, without allocating
+inline void report(rt_kind kind, const char* what){
+    static const char* kinds[] = {"allocation", "lock", "iostream"};
+    char line[160];
+    int n = snprintf(line, sizeof(line), "\n[rt guard] %s on the audio thread: %s\n", kinds[kind], what);
+    if(write(STDERR_FILENO, line, n) < 0) return;
+    void* frames[32];
+    int count = backtrace(frames, 32);
+    backtrace_symbols_fd(frames + 2, count - 2, STDERR_FILENO); // skip report() and violation()
+}
+#endif
+
+// called by the hooks, counts what if the thread is inside an RtScope
+inline void violation(rt_kind kind, const char* what){
+    (void)what; // only reported with ENGINE_RT_GUARD
+    if(depth == 0 || reporting) return;
+    reporting = true;
+    counts[kind].fetch_add(1, std::memory_order_relaxed);
+#ifdef ENGINE_RT_GUARD
+    if(reportsLeft.fetch_sub(1, std::memory_order_relaxed) > 0) report(kind, what);
+    if(abortOnViolation.load(std::memory_order_relaxed)) abort();
+#endif
+    reporting = false;
+}
+
+#ifdef ENGINE_RT_GUARD
+// forwards to the original stream buffer, flags writes on the audio thread
+class GuardBuf : public std::streambuf {
+    public:
+        explicit GuardBuf(std::streambuf* target) : mTarget(target) {}
+
+    protected:
+        int_type overflow(int_type c) override {
+            violation(rt_iostream, "stream output");
+            return traits_type::eq_int_type(c, traits_type::eof()) ? traits_type::not_eof(c) : mTarget->sputc((char)c);
+        }
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            violation(rt_iostream, "stream output");
+            return mTarget->sputn(s, n);
+        }
+        int sync() override { return mTarget->pubsync(); }
+
+    private:
+        std::streambuf* mTarget;
+};
+
+typedef int (*mutex_lock_fn)(pthread_mutex_t*);
+
+// libc's pthread_mutex_lock, looked up once
+inline mutex_lock_fn realMutexLock(){
+    static mutex_lock_fn fn = (mutex_lock_fn)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    return fn;
+}
+#endif
+
+}
+
+// marks the current thread as the audio thread while alive
+class RtScope {
+    public:
+        RtScope(){ rtguard::depth++; }
+        ~RtScope(){ rtguard::depth--; }
+        RtScope(const RtScope&) = delete;
+        RtScope& operator=(const RtScope&) = delete;
+};
+
+// hooks the standard streams and warms up the call stack printer, call before audio starts
+inline void rtGuardInstall(bool abortOnViolation = false){
+    rtguard::abortOnViolation.store(abortOnViolation);
+#ifdef ENGINE_RT_GUARD
+    static rtguard::GuardBuf out(std::cout.rdbuf()), err(std::cerr.rdbuf()), log(std::clog.rdbuf());
+    static bool installed = false;
+    if(installed) return;
+    installed = true;
+    std::cout.rdbuf(&out);
+    std::cerr.rdbuf(&err);
+    std::clog.rdbuf(&log);
+
+    // the first backtrace() loads libgcc, and dlsym may allocate: get both done now
+    void* frames[4];
+    backtrace(frames, 4);
+    rtguard::realMutexLock();
+#endif
+}
+
+inline rt_violations rtViolations(){
+    rt_violations v;
+    v.allocations = rtguard::counts[rt_allocation].load(std::memory_order_relaxed);
+    v.locks = rtguard::counts[rt_lock].load(std::memory_order_relaxed);
+    v.iostream = rtguard::counts[rt_iostream].load(std::memory_order_relaxed);
+    return v;
+}
+
+}
+
+#ifdef ENGINE_RT_GUARD
+
+// Replacement allocation functions, see the note above about one translation unit
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t size){
+    engine::rtguard::violation(engine::rt_allocation, "malloc");
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size){
+    engine::rtguard::violation(engine::rt_allocation, "calloc");
+    return __libc_calloc(count, size);
+}
+void* realloc(void* p, size_t size){
+    engine::rtguard::violation(engine::rt_allocation, "realloc");
+    return __libc_realloc(p, size);
+}
+void free(void* p){
+    if(p) engine::rtguard::violation(engine::rt_allocation, "free");
+    __libc_free(p);
+}
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    engine::rtguard::violation(engine::rt_allocation, "aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+void* memalign(size_t alignment, size_t size) noexcept {
+    engine::rtguard::violation(engine::rt_allocation, "memalign");
+    return __libc_memalign(alignment, size);
+}
+int posix_memalign(void** p, size_t alignment, size_t size) noexcept {
+    engine::rtguard::violation(engine::rt_allocation, "posix_memalign");
+    if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    void* q = __libc_memalign(alignment, size);
+    if(!q) return ENOMEM;
+    *p = q;
+    return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex){
+    engine::rtguard::violation(engine::rt_lock, "pthread_mutex_lock");
+    return engine::rtguard::realMutexLock()(mutex);
+}
+}
+#define ENGINE_RT_MALLOC __libc_malloc
+#define ENGINE_RT_MEMALIGN __libc_memalign
+#define ENGINE_RT_FREE __libc_free
+#else
+#define ENGINE_RT_MALLOC std::malloc
+#define ENGINE_RT_MEMALIGN(alignment, size) std::aligned_alloc(alignment, ((size) + (alignment) - 1) / (alignment) * (alignment))
+#define ENGINE_RT_FREE std::free
+#endif
+
+void* operator new(std::size_t size){
+    engine::rtguard::violation(engine::rt_allocation, "operator new");
+    void* p = ENGINE_RT_MALLOC(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](std::size_t size){ return operator new(size); }
+void operator delete(void* p) noexcept {
+    if(p) engine::rtguard::violation(engine::rt_allocation, "operator delete");
+    ENGINE_RT_FREE(p);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete(p); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    engine::rtguard::violation(engine::rt_allocation, "operator new");
+    return ENGINE_RT_MALLOC(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+
+// over-aligned types (alignas above 16, like ParallelRender's job ranges)
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    engine::rtguard::violation(engine::rt_allocation, "aligned operator new");
+    return ENGINE_RT_MEMALIGN((std::size_t)alignment, size ? size : 1);
+}
+void* operator new(std::size_t size, std::align_val_t alignment){
+    void* p = operator new(size, alignment, std::nothrow);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](std::size_t size, std::align_val_t alignment){ return operator new(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept {
+    return operator new(size, alignment, tag);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    if(p) engine::rtguard::violation(engine::rt_allocation, "aligned operator delete");
+    ENGINE_RT_FREE(p);
+}
+void operator delete[](void* p, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete[](void* p, std::size_t, std::align_val_t alignment) noexcept { operator delete(p, alignment); }
+void operator delete(void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept { operator delete(p, alignment); }
+void operator delete[](void* p, std::align_val_t alignment, const std::nothrow_t&) noexcept { operator delete(p, alignment); }
+
+#undef ENGINE_RT_MALLOC
+#undef ENGINE_RT_MEMALIGN
+#undef ENGINE_RT_FREE
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+
+namespace engine {
+
+/*
+    SilenceDetector: tells a voice when its output has died away
+
+        For voices without an envelope that reports done(), e.g. gam::Burst.
+        The voice is done once its peak stays below threshold for holdSeconds,
+        or maxSeconds after the trigger at the latest (0 = no limit).
+
+        mDone.set(1e-4, 0.005, 0.25);        // init()
+        mDone.reset(gam::sampleRate());      // onTriggerOn()
+        mDone.process(buffer, frames);       // every rendered chunk
+        if (mDone.done()) free();
+*/
+class SilenceDetector {
+    public:
+        void set(float threshold, double holdSeconds, double maxSeconds = 0){
+            mThreshold = threshold;
+            mHoldSeconds = holdSeconds;
+            mMaxSeconds = maxSeconds;
+        }
+
+        // starts a new note
+        void reset(double sampleRate){
+            mHoldFrames = (long)std::ceil(mHoldSeconds * sampleRate);
+            mMaxFrames = (long)std::ceil(mMaxSeconds * sampleRate);
+            mQuiet = 0;
+            mElapsed = 0;
+        }
+
+        // checks frames samples of output, returns done()
+        bool process(const float* in, int frames){
+            float peak = 0;
+            for(int i=0; i<frames; i++) peak = std::fmax(peak, std::fabs(in[i]));
+
+            mQuiet = peak < mThreshold ? mQuiet + frames : 0;
+            mElapsed += frames;
+            return done();
+        }
+
+        bool done() const {
+            return mQuiet >= mHoldFrames || (mMaxFrames > 0 && mElapsed >= mMaxFrames);
+        }
+
+    private:
+        float mThreshold = 1e-4f;
+        double mHoldSeconds = 0.005;
+        double mMaxSeconds = 0;
+        long mHoldFrames = 0;
+        long mMaxFrames = 0;
+        long mQuiet = 0;
+        long mElapsed = 0;
+};
+
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wavreader.h"
+
+namespace engine {
+
+/*
+    SampleStream: plays a long .wav file from disk without loading it
+
+        open() only reads the header and starts a reader thread, so startup
+        takes the same time for a 1 MB or a 500 MB file. The thread keeps
+        readAheadSeconds of audio decoded in a lock-free ring, the audio
+        thread only ever copies out of memory that is already filled.
+
+        engine::SampleStream track;
+        track.open("backing.wav", 2.0, audioIO().framesPerSecond()); // onCreate(), any thread
+        track.reset();                                          // UI thread, play from the start
+        track.read(left, right, frames);                        // onSound()
+
+    The first readAheadSeconds of the file are kept in a cue buffer, so
+    reset() plays from memory at once while the thread seeks and refills
+    the ring behind it. If the thread falls behind, read() plays silence
+    and counts it in underruns(). Mono files play on both channels.
+    A file at another rate than outputRate is resampled in read() with
+    linear interpolation, so it plays at its own speed and pitch.
+*/
+class SampleStream {
+    public:
+        ~SampleStream(){ close(); }
+
+        // opens path and starts streaming, returns false if it isn't a readable wav
+        // (outputRate 0 plays the file's frames as they are)
+        bool open(const std::string& path, double readAheadSeconds = 2.0, double outputRate = 0){
+            close();
+            if(!mFile.open(path)) return false;
+            mStep = outputRate > 0 ? mFile.sampleRate() / outputRate : 1.0;
+            mSourceL.assign(chunkFrames, 0.0f);
+            mSourceR.assign(chunkFrames, 0.0f);
+
+            int64_t readAhead = std::max<int64_t>((int64_t)(readAheadSeconds * mFile.sampleRate()), chunkFrames);
+            mCueFrames = std::min(readAhead, mFile.frames());
+            mCue.assign(mCueFrames * 2, 0.0f);
+            mRingFrames = 1;
+            while((int64_t)mRingFrames < readAhead) mRingFrames <<= 1;
+            mRing.assign(mRingFrames * 2, 0.0f);
+            mChunk.assign(chunkFrames * mFile.channels(), 0.0f);
+            mStereo.assign(chunkFrames * 2, 0.0f);
+
+            mHead.store(0);
+            mTail.store(0);
+            mCueReady.store(false);
+            mRequest.store(0);
+            mSeek.store(0);
+            mRestart.store(0);
+            mRestartAt.store(0);
+            mReaderSeek = 0;
+            mPlaying = 0;
+            mSkipped = 0;
+            mPosition = 0;
+            restartResampler();
+            mUnderruns.store(0);
+            mUnderrunFrames.store(0);
+
+            mQuit.store(false);
+            mReader = std::thread([this] { readLoop(); });
+            return true;
+        }
+
+        void close(){
+            if(mReader.joinable()){
+                mQuit.store(true);
+                mReader.join();
+            }
+            mFile.close();
+        }
+
+        // plays from the start on the next read(), safe from any one non-audio thread
+        void reset(){ mRequest.fetch_add(1, std::memory_order_release); }
+
+        // audio thread: fills frames samples of left and right (silence past the end)
+        // returns frames that had audio
+        int read(float* left, float* right, int frames){
+            if(takeReset()) restartResampler();
+            if(mStep == 1.0) return readFile(left, right, frames);
+
+            int done = 0;
+            // in pieces that need at most chunkFrames frames of the file
+            int most = std::max((int)((chunkFrames - 2) / mStep), 1);
+            for(int start = 0; start < frames; ){
+                int n = std::min(frames - start, most);
+                int need = (int)(mPhase + (n - 1) * mStep) + 1;
+                int got = readFile(mSourceL.data(), mSourceR.data(), need);
+
+                // output i sits at mPhase + i * mStep frames past mLast
+                for(int i=0; i<n; i++){
+                    double pos = mPhase + i * mStep;
+                    int j = (int)pos;
+                    float f = (float)(pos - j);
+                    float aL = j == 0 ? mLast[0] : mSourceL[j - 1];
+                    float aR = j == 0 ? mLast[1] : mSourceR[j - 1];
+                    left[start + i] = aL + f * (mSourceL[j] - aL);
+                    right[start + i] = aR + f * (mSourceR[j] - aR);
+                }
+                // outputs that only used frames with audio
+                done += std::min(n, std::max((int)std::ceil((got - mPhase) / mStep), 0));
+
+                mLast[0] = mSourceL[need - 1];
+                mLast[1] = mSourceR[need - 1];
+                mPhase += n * mStep - need;
+                start += n;
+            }
+            return done;
+        }
+
+        // audio thread: true once the whole file has been played
+        bool done() const { return mPosition >= mFile.frames(); }
+
+        int64_t frames() const { return mFile.frames(); }
+        double sampleRate() const { return mFile.sampleRate(); }
+
+        // blocks that had to play silence because the reader fell behind
+        long underruns() const { return mUnderruns.load(std::memory_order_relaxed); }
+        long underrunFrames() const { return mUnderrunFrames.load(std::memory_order_relaxed); }
+
+    private:
+        const static int chunkFrames = 4096;   // frames per file read
+        constexpr static int pollMillis = 2;   // reader sleep when the ring is full
+
+        // first output of a play is the file's first frame
+        void restartResampler(){
+            mPhase = 1.0;
+            mLast[0] = mLast[1] = 0.0f;
+        }
+
+        // audio thread: the next frames of the file, at its own rate
+        int readFile(float* left, float* right, int frames){
+            int done = 0;
+            // from the cue buffer, filled once by the reader thread
+            if(mPosition < mCueFrames && mCueReady.load(std::memory_order_acquire)){
+                int n = (int)std::min<int64_t>(frames, mCueFrames - mPosition);
+                const float* cue = mCue.data() + mPosition * 2;
+                for(int i=0; i<n; i++){
+                    left[i] = cue[2 * i];
+                    right[i] = cue[2 * i + 1];
+                }
+                done = n;
+                mPosition += n;
+            }
+
+            // then from the ring, once the reader has restarted it for this play
+            if(done < frames && mPosition >= mCueFrames && mSkipped == mPlaying){
+                size_t tail = mTail.load(std::memory_order_relaxed);
+                size_t head = mHead.load(std::memory_order_acquire);
+                int n = (int)std::min<size_t>(frames - done, head - tail);
+                for(int i=0; i<n; i++){
+                    const float* frame = mRing.data() + ((tail + i) & (mRingFrames - 1)) * 2;
+                    left[done + i] = frame[0];
+                    right[done + i] = frame[1];
+                }
+                mTail.store(tail + n, std::memory_order_release);
+                done += n;
+                mPosition += n;
+            }
+
+            int missing = (int)std::min<int64_t>(frames - done, mFile.frames() - mPosition);
+            if(missing > 0){
+                mUnderruns.fetch_add(1, std::memory_order_relaxed);
+                mUnderrunFrames.fetch_add(missing, std::memory_order_relaxed);
+            }
+            std::fill(left + done, left + frames, 0.0f);
+            std::fill(right + done, right + frames, 0.0f);
+            return done;
+        }
+
+        // audio thread: starts a new play if reset() was called, returns true if it did
+        bool takeReset(){
+            bool started = false;
+            int request = mRequest.load(std::memory_order_acquire);
+            if(request != mPlaying){
+                mPlaying = request;
+                mPosition = 0;
+                mSeek.store(request, std::memory_order_release); // reader refills the ring
+                started = true;
+            }
+            // drop what the reader queued for the previous play
+            if(mSkipped != mPlaying && mRestart.load(std::memory_order_acquire) == mPlaying){
+                mTail.store(mRestartAt.load(std::memory_order_relaxed), std::memory_order_release);
+                mSkipped = mPlaying;
+            }
+            return started;
+        }
+
+        // reader thread
+        void readLoop(){
+            fillCue();
+            restart(0);
+            while(!mQuit.load(std::memory_order_relaxed)){
+                int seek = mSeek.load(std::memory_order_acquire);
+                if(seek != mReaderSeek) restart(seek);
+                if(!fillRing()) std::this_thread::sleep_for(std::chrono::milliseconds(pollMillis));
+            }
+        }
+
+        void fillCue(){
+            for(int64_t frame = 0; frame < mCueFrames; ){
+                int n = mFile.read(mChunk.data(), (int)std::min<int64_t>(chunkFrames, mCueFrames - frame));
+                if(n <= 0) break;
+                toStereo(mCue.data() + frame * 2, n);
+                frame += n;
+            }
+            mCueReady.store(true, std::memory_order_release);
+        }
+
+        // ring continues the file after the cue, from the current head
+        void restart(int seek){
+            mFile.seek(mCueFrames);
+            mReaderSeek = seek;
+            mRestartAt.store(mHead.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            mRestart.store(seek, std::memory_order_release);
+        }
+
+        // reads one chunk into the ring, returns false if there was nothing to do
+        bool fillRing(){
+            size_t head = mHead.load(std::memory_order_relaxed);
+            size_t space = mRingFrames - (head - mTail.load(std::memory_order_acquire));
+            int n = (int)std::min<size_t>(space, chunkFrames);
+            if(n == 0) return false;
+            n = mFile.read(mChunk.data(), n);
+            if(n == 0) return false;
+
+            toStereo(mStereo.data(), n);
+            for(int i=0; i<n; i++){
+                float* frame = mRing.data() + ((head + i) & (mRingFrames - 1)) * 2;
+                frame[0] = mStereo[2 * i];
+                frame[1] = mStereo[2 * i + 1];
+            }
+            mHead.store(head + n, std::memory_order_release);
+            return true;
+        }
+
+        // converts n frames of mChunk to interleaved stereo
+        void toStereo(float* out, int n) const {
+            int channels = mFile.channels();
+            const float* in = mChunk.data();
+            for(int i=0; i<n; i++, in += channels){
+                out[2 * i] = in[0];
+                out[2 * i + 1] = channels > 1 ? in[1] : in[0];
+            }
+        }
+
+        WavReader mFile;          // reader thread only after open()
+        int64_t mCueFrames = 0;
+        std::vector<float> mCue;  // first frames of the file, interleaved stereo
+        std::vector<float> mRing; // frames after the cue, interleaved stereo
+        size_t mRingFrames = 0;   // power of 2
+        std::vector<float> mChunk;  // one file read, file channels
+        std::vector<float> mStereo; // the same read as stereo
+
+        std::thread mReader;
+        std::atomic<bool> mQuit{false};
+        std::atomic<bool> mCueReady{false};
+
+        // ring indices in frames, on separate cache lines
+        alignas(64) std::atomic<size_t> mHead{0};
+        alignas(64) std::atomic<size_t> mTail{0};
+
+        // play counters: UI asks for a play, audio thread asks the reader to seek,
+        // reader says where in the ring that play's frames begin
+        alignas(64) std::atomic<int> mRequest{0};
+        std::atomic<int> mSeek{0};
+        std::atomic<int> mRestart{0};
+        std::atomic<size_t> mRestartAt{0};
+        int mReaderSeek = 0;      // reader thread
+        int mPlaying = 0;         // audio thread
+        int mSkipped = 0;         // audio thread, last play whose stale frames were dropped
+        int64_t mPosition = 0;    // audio thread, frame of the file
+
+        // resampling, audio thread
+        double mStep = 1.0;       // file frames per output frame
+        double mPhase = 1.0;      // next output, in file frames past mLast
+        float mLast[2] = {};      // last file frame read
+        std::vector<float> mSourceL, mSourceR; // file frames for one piece
+
+        std::atomic<long> mUnderruns{0};
+        std::atomic<long> mUnderrunFrames{0};
+};
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace engine {
+
+/*
+    FrameClock: frames rendered so far, for timestamping events
+
+        The audio thread advances it at the end of every block, other threads
+        read it to place events on the audio timeline (in absolute frames).
+
+        int64_t start = clock.now() + io.framesPerBuffer();   // UI: one block of latency
+        clock.advance(io.framesPerBuffer());                  // audio: end of onSound()
+*/
+class FrameClock {
+    public:
+        int64_t now() const { return mFrame.load(std::memory_order_acquire); }
+        void advance(int frames){ mFrame.store(mFrame.load(std::memory_order_relaxed) + frames, std::memory_order_release); }
+
+    private:
+        std::atomic<int64_t> mFrame{0};
+};
+
+/*
+    Timeline: events waiting for their frame, owned by the audio thread
+
+        Fixed capacity, nothing is allocated after construction. Events added
+        when full are dropped and counted in overflows().
+
+        timeline.add(frame, event);
+        timeline.take(blockEnd, [&](const Event& e, int64_t frame) { ... });
+*/
+template<class T, int Capacity>
+class Timeline {
+    public:
+        // returns false if the timeline was full
+        bool add(int64_t frame, const T& value){
+            if(mCount == Capacity){
+                mOverflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            mEvents[mCount++] = entry{frame, value};
+            if(mCount > mHighWater.load(std::memory_order_relaxed)) mHighWater.store(mCount, std::memory_order_relaxed);
+            return true;
+        }
+
+        // calls fn(value, frame) for every event before end (in no particular order) and removes them
+        template<class Fn>
+        void take(int64_t end, Fn&& fn){
+            for(int i=0; i<mCount; ){
+                if(mEvents[i].frame < end){
+                    entry e = mEvents[i];
+                    mEvents[i] = mEvents[--mCount];
+                    fn(e.value, e.frame);
+                }
+                else i++;
+            }
+        }
+
+        void clear(){ mCount = 0; }
+
+        int size() const { return mCount; }
+        // counters can be read from any thread
+        int highWater() const { return mHighWater.load(std::memory_order_relaxed); }
+        long overflows() const { return mOverflows.load(std::memory_order_relaxed); }
+
+    private:
+        struct entry {
+            int64_t frame;
+            T value;
+        };
+
+        entry mEvents[Capacity];
+        int mCount = 0;
+        std::atomic<int> mHighWater{0};
+        std::atomic<long> mOverflows{0};
+};
+
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "al/io/al_AudioIOData.hpp"
+#include "al/scene/al_PolySynth.hpp"
+
+namespace engine {
+
+/*
+    VoiceCounter: voice occupancy of a PolySynth or of VoicePools
+
+        Call update() from onSound() after the voices have rendered, read the
+        counts from any thread (GUI, logging) to check the pool stays bounded.
+
+        voices.update(synthManager.synth());
+        voices.update(kicks.active() + snares.active());     // VoicePools
+        ImGui::Text("voices %d (peak %d)", voices.active(), voices.peak());
+*/
+class VoiceCounter {
+    public:
+        // walks the active list, only safe on the audio thread
+        void update(al::PolySynth& synth){
+            int count = 0;
+            for(al::SynthVoice* v = synth.getActiveVoices(); v; v = v->next) count++;
+            update(count);
+        }
+
+        void update(int count){
+            mActive.store(count, std::memory_order_relaxed);
+            if(count > mPeak.load(std::memory_order_relaxed)) mPeak.store(count, std::memory_order_relaxed);
+        }
+
+        int active() const { return mActive.load(std::memory_order_relaxed); }
+        int peak() const { return mPeak.load(std::memory_order_relaxed); }
+        void resetPeak(){ mPeak.store(active(), std::memory_order_relaxed); }
+
+    private:
+        std::atomic<int> mActive{0};
+        std::atomic<int> mPeak{0};
+};
+
+// a started note, kept to stop it later (its voice may be reused by then)
+struct note_ref {
+    al::SynthVoice* voice;
+    int id;
+};
+
+// sends a note off offset frames into the current block, if the voice still plays that note
+inline void releaseNote(const note_ref& note, int offset){
+    if(note.voice && note.voice->active() && note.voice->id() == note.id) note.voice->triggerOff(offset);
+}
+
+// what PolySynth::render() does for one voice: starts it on its offset frame
+inline void renderVoice(al::SynthVoice* voice, al::AudioIOData& io){
+    if(!voice->active()) return;
+    int frames = io.framesPerBuffer();
+    int offset = voice->getStartOffsetFrames(frames);
+    if(offset < frames){
+        io.frame(offset);
+        voice->onProcess(io);
+    }
+}
+
+/*
+    VoicePool: fixed number of voices of one type, allocated up front
+
+        The pool owns its voices and renders them itself, so starting a
+        note never touches the PolySynth: getVoice() locks the synth's free
+        list (and allocates when it is empty), triggerOn() locks its insert
+        list. Once capacity voices are sounding, a sounding voice is stolen
+        by policy:
+
+            steal_oldest      longest playing voice
+            steal_quietest    lowest level (see level()), oldest if none set
+            steal_same_pitch  oldest voice on the same pitch, else oldest
+
+        The victim plays out the block and is freed after render(), and the
+        new note gets one of the reserve voices meanwhile, so the pool holds
+        capacity + reserve voices. If no voice is free (every reserve voice
+        taken by steals this block) acquire() returns nullptr, counted as
+        a drop. Set a fade function (see fade()) so the victim fades out
+        over that block instead of stopping dead, which clicks.
+
+        kicks.allocate(16, engine::steal_same_pitch);         // onInit()
+        kicks.fade([](Kick& k) { k.mAmp.parameter().set(0); });
+        Kick* voice = kicks.acquire(freq);                    // instead of getVoice<Kick>()
+        if (voice) kicks.triggerOn(voice, offset, id);        // instead of synth.triggerOn()
+        kicks.render(io);                                     // onSound(), next to the synth's render
+
+    Everything but the counters is for the audio thread. A voice acquired
+    but not started by the end of the next render() goes back to the pool.
+*/
+enum steal_policy {
+    steal_oldest, steal_quietest, steal_same_pitch
+};
+
+template<class Voice>
+class VoicePool {
+    public:
+        // level of a sounding voice for steal_quietest, called on the audio thread
+        typedef float (*level_fn)(Voice&);
+        // starts fading out a voice being stolen, to silence by the end of
+        // the block (e.g. a SmoothedParameter amplitude set to 0 ramps there)
+        typedef void (*fade_fn)(Voice&);
+
+        // allocates and init()s capacity + reserve voices
+        // (reserve < 0 picks a quarter of capacity, at least one)
+        void allocate(int capacity, steal_policy policy = steal_oldest, int reserve = -1){
+            if(reserve < 0) reserve = std::max(capacity / 4, 1);
+            mCapacity = capacity;
+            mPolicy = policy;
+            mCount = capacity + reserve;
+            mVoices.reset(new Voice[mCount]);
+            mSlots.reset(new slot[mCount]);
+            mFree.reset(new int[mCount]);
+            mFreeCount = 0;
+            mSounding = nullptr;
+            mPlaying = 0;
+            mActive.store(0, std::memory_order_relaxed);
+            for(int i=mCount-1; i>=0; i--){
+                mVoices[i].init();
+                mFree[mFreeCount++] = i;
+            }
+        }
+
+        void level(level_fn fn){ mLevel = fn; }
+        void fade(fade_fn fn){ mFade = fn; }
+
+        // returns a free voice for a note at pitch, stealing if the pool is full
+        // returns nullptr (and counts a drop) if every voice is taken
+        Voice* acquire(float pitch = 0){
+            if(mFreeCount == 0){
+                mDrops.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            if(mPlaying >= mCapacity){
+                int victim = pickVictim(pitch);
+                if(victim < 0){
+                    mDrops.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                mSlots[victim].state = slot_stealing;
+                if(mFade) mFade(mVoices[victim]);
+                mPlaying--;
+                mSteals.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            int index = mFree[--mFreeCount];
+            slot& s = mSlots[index];
+            s.state = slot_acquired;
+            s.pitch = pitch;
+            s.level = 0;
+            return &mVoices[index];
+        }
+
+        // starts an acquired voice offset frames into the block, returns id
+        // returns -1 (and counts a drop) if voice isn't waiting in this pool
+        int triggerOn(Voice* voice, int offset, int id){
+            int index = slotOf(voice);
+            if(index < 0 || mSlots[index].state != slot_acquired){
+                mDrops.fetch_add(1, std::memory_order_relaxed);
+                return -1;
+            }
+            slot& s = mSlots[index];
+            s.state = slot_playing;
+            s.serial = ++mSerial;
+            voice->id(id);
+            voice->triggerOn(offset);
+            voice->next = mSounding;
+            mSounding = voice;
+
+            mPlaying++;
+            if(mPlaying > mHighWater.load(std::memory_order_relaxed)) mHighWater.store(mPlaying, std::memory_order_relaxed);
+            mActive.store(mPlaying, std::memory_order_relaxed);
+            return id;
+        }
+
+        // adds every sounding voice into io, then update()
+        void render(al::AudioIOData& io){
+            for(al::SynthVoice* v = mSounding; v; v = v->next) renderVoice(v, io);
+            update();
+        }
+
+        // sounding voices, linked through SynthVoice::next, for other renderers (call update() after)
+        al::SynthVoice* voices(){ return mSounding; }
+
+        // frees stolen voices and takes back finished ones, call after the voices rendered
+        void update(){
+            al::SynthVoice* prev = nullptr;
+            for(al::SynthVoice* v = mSounding; v; ){
+                al::SynthVoice* next = v->next;
+                int index = slotOf(static_cast<Voice*>(v)); // only our voices are linked here
+                slot& s = mSlots[index];
+                if(s.state == slot_stealing && v->active()) v->free(); // faded out over this block
+                if(v->active()){
+                    if(mLevel) s.level = mLevel(*static_cast<Voice*>(v));
+                    prev = v;
+                }
+                else{
+                    if(s.state == slot_playing) mPlaying--;
+                    (prev ? prev->next : mSounding) = next;
+                    v->next = nullptr;
+                    release(index);
+                }
+                v = next;
+            }
+            // acquired last block but never started
+            for(int i=0; i<mCount; i++){
+                if(mSlots[i].state == slot_acquired && mSlots[i].stale) release(i);
+                else if(mSlots[i].state == slot_acquired) mSlots[i].stale = true;
+            }
+            mActive.store(mPlaying, std::memory_order_relaxed);
+        }
+
+        // every voice of the pool, capacity + reserve of them, to set up
+        // after allocate() (e.g. where they send)
+        int size() const { return mCount; }
+        Voice& voice(int index){ return mVoices[index]; }
+
+        // counters can be read from any thread
+        int capacity() const { return mCapacity; }
+        // voices sounding after the last render(), stolen ones not counted
+        int active() const { return mActive.load(std::memory_order_relaxed); }
+        long steals() const { return mSteals.load(std::memory_order_relaxed); }
+        long drops() const { return mDrops.load(std::memory_order_relaxed); }
+        // most voices sounding at once
+        int highWater() const { return mHighWater.load(std::memory_order_relaxed); }
+
+    private:
+        enum { slot_idle, slot_acquired, slot_playing, slot_stealing };
+
+        struct slot {
+            int state = slot_idle;
+            bool stale = false; // acquired before the last update()
+            uint64_t serial = 0;
+            float pitch = 0;
+            float level = 0;
+        };
+
+        // returns the slot holding voice, -1 if it isn't one of ours
+        int slotOf(const Voice* voice) const {
+            const Voice* first = mVoices.get();
+            std::less<const Voice*> before; // total order, voice may be from another pool
+            if(before(voice, first) || !before(voice, first + mCount)) return -1;
+            return (int)(voice - first);
+        }
+
+        void release(int index){
+            mSlots[index].state = slot_idle;
+            mSlots[index].stale = false;
+            mFree[mFreeCount++] = index;
+        }
+
+        // returns the sounding voice to steal, -1 if none is sounding
+        int pickVictim(float pitch){
+            int victim = -1;
+            float victimRank = 0;
+            for(int i=0; i<mCount; i++){
+                const slot& s = mSlots[i];
+                if(s.state != slot_playing) continue;
+
+                // lower rank is stolen first, ties go to the oldest
+                float rank = 0;
+                if(mPolicy == steal_same_pitch) rank = std::fabs(s.pitch - pitch) < 1e-3f ? 0 : 1;
+                else if(mPolicy == steal_quietest && mLevel) rank = s.level;
+
+                if(victim < 0 || rank < victimRank || (rank == victimRank && s.serial < mSlots[victim].serial)){
+                    victim = i;
+                    victimRank = rank;
+                }
+            }
+            return victim;
+        }
+
+        std::unique_ptr<Voice[]> mVoices;
+        std::unique_ptr<slot[]> mSlots;
+        std::unique_ptr<int[]> mFree;   // indices of idle voices
+        int mFreeCount = 0;
+        al::SynthVoice* mSounding = nullptr;
+        int mPlaying = 0;               // sounding and not being stolen
+        int mCount = 0;
+        int mCapacity = 0;
+        steal_policy mPolicy = steal_oldest;
+        level_fn mLevel = nullptr;
+        fade_fn mFade = nullptr;
+        uint64_t mSerial = 0;
+        std::atomic<int> mActive{0};
+        std::atomic<long> mSteals{0};
+        std::atomic<long> mDrops{0};
+        std::atomic<int> mHighWater{0};
+};
+
+}
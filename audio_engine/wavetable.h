@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+
+/*
+    Wavetable: one cycle of a waveform, mip-mapped by harmonic count
+
+        Built once from its harmonic amplitudes and shared by every voice.
+        Level k holds the first 2^k harmonics (the top level holds all of
+        them), and an oscillator picks the fullest level with nothing above
+        Nyquist at its frequency, so high notes lose harmonics instead of
+        aliasing.
+
+        // odd harmonics at 1/n up to the 7th: f, 3f, 5f, 7f
+        static const engine::Wavetable square(7, [](int n) { return n % 2 ? 1.0 / n : 0.0; });
+*/
+class Wavetable {
+    public:
+        const static int sizeBits = 11;
+        const static int size = 1 << sizeBits; // samples per cycle
+
+        // harmonic(n) returns the sine amplitude of harmonic n, 1 <= n <= maxHarmonic
+        template<class Harmonic>
+        Wavetable(int maxHarmonic, Harmonic&& harmonic){
+            int levels = 1;
+            while((1 << (levels - 1)) < maxHarmonic) levels++;
+            mLevels.resize(levels);
+
+            std::vector<double> sum(size);
+            const double twoPi = 6.283185307179586;
+            for(int k=0; k<levels; k++){
+                int harmonics = std::min(1 << k, maxHarmonic);
+                // sum is carried up from the level below, only the new harmonics are added
+                for(int n = k == 0 ? 1 : (1 << (k - 1)) + 1; n <= harmonics; n++){
+                    double amp = harmonic(n);
+                    if(amp == 0) continue;
+                    for(int i=0; i<size; i++) sum[i] += amp * std::sin(twoPi * n * i / size);
+                }
+                std::vector<float>& table = mLevels[k];
+                table.resize(size + 1); // guard point for interpolation
+                for(int i=0; i<size; i++) table[i] = (float)sum[i];
+                table[size] = table[0];
+            }
+        }
+
+        // returns level for a fundamental of freq Hz (highest harmonic below Nyquist)
+        int level(float freq, float sampleRate) const {
+            float harmonics = 0.5f * sampleRate / freq;
+            int k = harmonics >= 1 ? std::ilogb(harmonics) : 0;
+            return std::min(k, levels() - 1);
+        }
+
+        const float* table(int level) const { return mLevels[level].data(); }
+        int levels() const { return (int)mLevels.size(); }
+
+    private:
+        std::vector<std::vector<float>> mLevels;
+};
+
+/*
+    TableOsc: reads a shared Wavetable with linear interpolation
+
+        One phase accumulator and one interpolated table read per sample,
+        whatever the number of harmonics. The mip level is chosen when the
+        frequency is set, so call freq() once per block.
+
+        mOsc.table(square);                        // init()
+        mOsc.freq(f, gam::sampleRate());           // onProcess(), once per block
+        mOsc.fill(buffer, frames);                 // or mOsc() per sample
+*/
+class TableOsc {
+    public:
+        void table(const Wavetable& table){ mWavetable = &table; }
+
+        void freq(float freq, float sampleRate){
+            mIncrement = (uint32_t)(int64_t)std::llround((double)freq / sampleRate * 4294967296.0);
+            mTable = mWavetable->table(mWavetable->level(freq, sampleRate));
+        }
+
+        // starts the next cycle from phase 0
+        void reset(){ mPhase = 0; }
+
+        float operator()(){
+            float s = read(mPhase);
+            mPhase += mIncrement;
+            return s;
+        }
+
+        // writes the next frames samples to out
+        void fill(float* out, int frames){
+            uint32_t phase = mPhase;
+            for(int i=0; i<frames; i++){
+                out[i] = read(phase);
+                phase += mIncrement;
+            }
+            mPhase = phase;
+        }
+
+    private:
+        const static int fractionBits = 32 - Wavetable::sizeBits;
+
+        float read(uint32_t phase) const {
+            uint32_t index = phase >> fractionBits;
+            float fraction = (phase & ((1u << fractionBits) - 1)) * (1.0f / (1u << fractionBits));
+            float a = mTable[index];
+            return a + fraction * (mTable[index + 1] - a);
+        }
+
+        const Wavetable* mWavetable = nullptr;
+        const float* mTable = nullptr;
+        uint32_t mPhase = 0;     // full cycle = 2^32
+        uint32_t mIncrement = 0;
+};
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace engine {
+
+/*
+    WavReader: reads a .wav file a chunk at a time as float samples
+
+        Only the header is read by open(), the samples are read on demand,
+        so opening a file takes the same time whatever its length.
+        Reads 16, 24 and 32-bit integer PCM and 32-bit float files.
+
+        WavReader wav;
+        if (!wav.open("track.wav")) ...
+        int got = wav.read(interleaved, numFrames);  // until it returns 0
+        wav.seek(0);                                 // back to the start
+*/
+class WavReader {
+    public:
+        ~WavReader(){ close(); }
+
+        bool open(const std::string& path){
+            close();
+            mFile = fopen(path.c_str(), "rb");
+            if(!mFile) return false;
+            if(!readHeader()){
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        // reads up to numFrames frames of interleaved samples, returns frames read
+        int read(float* interleaved, int numFrames){
+            if(!mFile) return 0;
+            int64_t left = mFrames - mPosition;
+            if(numFrames > left) numFrames = (int)left;
+            if(numFrames <= 0) return 0;
+
+            size_t bytes = (size_t)numFrames * mBlockAlign;
+            if(mRaw.size() < bytes) mRaw.resize(bytes);
+            int got = (int)(fread(mRaw.data(), 1, bytes, mFile) / mBlockAlign);
+
+            const unsigned char* b = mRaw.data();
+            int count = got * mChannels;
+            int width = mBits / 8;
+            for(int i=0; i<count; i++, b += width) interleaved[i] = sample(b);
+            mPosition += got;
+            return got;
+        }
+
+        // moves to frame, returns false if it is past the end
+        bool seek(int64_t frame){
+            if(!mFile || frame < 0 || frame > mFrames) return false;
+            if(fseek(mFile, (long)(mDataOffset + frame * mBlockAlign), SEEK_SET) != 0) return false;
+            mPosition = frame;
+            return true;
+        }
+
+        void close(){
+            if(!mFile) return;
+            fclose(mFile);
+            mFile = nullptr;
+        }
+
+        bool isOpen() const { return mFile != nullptr; }
+        int channels() const { return mChannels; }
+        double sampleRate() const { return mSampleRate; }
+        int64_t frames() const { return mFrames; }
+        int64_t position() const { return mPosition; }
+
+    private:
+        const static int formatPcm = 1;
+        const static int formatFloat = 3;
+        const static int formatExtensible = 0xFFFE;
+
+        // walks the chunks up to "data", leaves the file at the first sample
+        bool readHeader(){
+            unsigned char id[4];
+            uint32_t size;
+            if(!getId(id) || memcmp(id, "RIFF", 4) != 0) return false;
+            if(!get32(size)) return false;
+            if(!getId(id) || memcmp(id, "WAVE", 4) != 0) return false;
+
+            bool haveFormat = false;
+            while(getId(id) && get32(size)){
+                if(memcmp(id, "fmt ", 4) == 0){
+                    unsigned char fmt[40] = {};
+                    uint32_t keep = size < sizeof(fmt) ? size : sizeof(fmt);
+                    if(fread(fmt, 1, keep, mFile) != keep) return false;
+                    if(!skip(size - keep)) return false;
+
+                    int format = le16(fmt);
+                    mChannels = le16(fmt + 2);
+                    mSampleRate = le32(fmt + 4);
+                    mBlockAlign = le16(fmt + 12);
+                    mBits = le16(fmt + 14);
+                    // extensible files keep the real format in the sub format guid
+                    if(format == formatExtensible && keep >= 26) format = le16(fmt + 24);
+                    mFloat = format == formatFloat;
+
+                    if(format != formatPcm && format != formatFloat) return false;
+                    if(mFloat ? mBits != 32 : (mBits != 16 && mBits != 24 && mBits != 32)) return false;
+                    if(mChannels <= 0 || mBlockAlign != mChannels * mBits / 8) return false;
+                    haveFormat = true;
+                }
+                else if(memcmp(id, "data", 4) == 0){
+                    if(!haveFormat) return false;
+                    mDataOffset = ftell(mFile);
+                    mFrames = size / mBlockAlign;
+                    mPosition = 0;
+                    return true;
+                }
+                else if(!skip(size)) return false;
+            }
+            return false;
+        }
+
+        float sample(const unsigned char* b) const {
+            if(mFloat){
+                uint32_t bits = le32(b);
+                float f;
+                memcpy(&f, &bits, 4);
+                return f;
+            }
+            if(mBits == 16) return (int16_t)le16(b) / 32768.0f;
+            if(mBits == 24) return ((int32_t)(le32Bytes(b[0], b[1], b[2], 0) << 8) >> 8) / 8388608.0f;
+            return (int32_t)le32(b) / 2147483648.0f;
+        }
+
+        // chunks are padded to an even number of bytes
+        bool skip(uint32_t bytes){ return fseek(mFile, (long)bytes + (bytes & 1), SEEK_CUR) == 0; }
+
+        bool getId(unsigned char* id){ return fread(id, 1, 4, mFile) == 4; }
+        bool get32(uint32_t& v){
+            unsigned char b[4];
+            if(fread(b, 1, 4, mFile) != 4) return false;
+            v = le32(b);
+            return true;
+        }
+
+        // little endian regardless of host
+        static uint16_t le16(const unsigned char* b){ return (uint16_t)(b[0] | (b[1] << 8)); }
+        static uint32_t le32(const unsigned char* b){ return le32Bytes(b[0], b[1], b[2], b[3]); }
+        static uint32_t le32Bytes(uint32_t b0, uint32_t b1, uint32_t b2, uint32_t b3){
+            return b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
+        }
+
+        FILE* mFile = nullptr;
+        int mChannels = 0;
+        double mSampleRate = 0;
+        int mBlockAlign = 0;
+        int mBits = 0;
+        bool mFloat = false;
+        long mDataOffset = 0;
+        int64_t mFrames = 0;
+        int64_t mPosition = 0;
+        std::vector<unsigned char> mRaw; // one read's worth of file bytes
+};
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace engine {
+
+/*
+    WavWriter: streams interleaved 32-bit float audio to a .wav file
+
+        WavWriter wav;
+        wav.open("out.wav", 48000, 2);
+        wav.write(interleaved, numFrames);  // as many times as needed
+        wav.close();                        // patches header sizes
+*/
+class WavWriter {
+    public:
+        ~WavWriter(){ close(); }
+
+        bool open(const std::string& path, double sampleRate, int channels){
+            close();
+            mFile = fopen(path.c_str(), "wb");
+            if(!mFile) return false;
+
+            mChannels = channels;
+            mFrames = 0;
+
+            uint32_t rate = (uint32_t)sampleRate;
+            uint16_t blockAlign = (uint16_t)(channels * 4);
+
+            fwrite("RIFF", 1, 4, mFile);
+            put32(0);                       // patched in close()
+            fwrite("WAVE", 1, 4, mFile);
+
+            fwrite("fmt ", 1, 4, mFile);
+            put32(18);
+            put16(3);                       // WAVE_FORMAT_IEEE_FLOAT
+            put16((uint16_t)channels);
+            put32(rate);
+            put32(rate * blockAlign);
+            put16(blockAlign);
+            put16(32);
+            put16(0);
+
+            fwrite("fact", 1, 4, mFile);
+            put32(4);
+            put32(0);                       // frame count, patched in close()
+
+            fwrite("data", 1, 4, mFile);
+            put32(0);                       // patched in close()
+            return true;
+        }
+
+        // writes numFrames frames of interleaved samples
+        bool write(const float* interleaved, int numFrames){
+            if(!mFile) return false;
+            size_t count = (size_t)numFrames * mChannels;
+            if(fwrite(interleaved, sizeof(float), count, mFile) != count) return false;
+            mFrames += numFrames;
+            return true;
+        }
+
+        void close(){
+            if(!mFile) return;
+            uint32_t dataBytes = (uint32_t)(mFrames * mChannels * 4);
+            fseek(mFile, 4, SEEK_SET);
+            put32(headerBytes - 8 + dataBytes);
+            fseek(mFile, factOffset, SEEK_SET);
+            put32((uint32_t)mFrames);
+            fseek(mFile, headerBytes - 4, SEEK_SET);
+            put32(dataBytes);
+            fclose(mFile);
+            mFile = nullptr;
+        }
+
+        bool isOpen() const { return mFile != nullptr; }
+        int64_t frames() const { return mFrames; }
+
+    private:
+        const static long factOffset = 46;
+        const static long headerBytes = 58;
+
+        // little endian regardless of host
+        void put16(uint16_t v){
+            unsigned char b[2] = {(unsigned char)v, (unsigned char)(v >> 8)};
+            fwrite(b, 1, 2, mFile);
+        }
+        void put32(uint32_t v){
+            unsigned char b[4] = {(unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+            fwrite(b, 1, 4, mFile);
+        }
+
+        FILE* mFile = nullptr;
+        int mChannels = 0;
+        int64_t mFrames = 0;
+};
+
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+// The audio side of Drum_Demo: voice pools, grooves, the shared snare
+// reverb and the mixer, in a header so headless checks can play the
+// demo's keys without the app
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Gamma/Effects.h"
+#include "Gamma/Gamma.h"
+#include "Gamma/Spatial.h"
+
+#include "al/io/al_AudioIOData.hpp"
+
+#include "audio_engine/mixer.h"
+#include "audio_engine/offline.h"
+#include "audio_engine/pattern.h"
+#include "audio_engine/voices.h"
+
+#include "drum_voices.h"
+
+// Instruments in the step patterns, each is also a track of the mix
+enum Drum { KICK, HIHAT, SNARE, DRUMS };
+
+class DrumKit {
+ public:
+  // Shared snare reverb, fed by every snare voice through reverbSend
+  gam::ReverbMS<> reverb; // Schroeder reverberator
+  gam::Pan<> reverbPan;
+  engine::AuxBus reverbSend;
+
+  // Output stage: a bus per drum and the reverb return, summed in this
+  // order whoever rendered them. The app adds its own sources before init().
+  engine::Mixer mixer;
+  int drumBus[DRUMS] = {mixer.add(), mixer.add(), mixer.add()};
+  int reverbBus = mixer.add(0.2);
+
+  // Each drum's pool renders here, then into its bus
+  al::AudioIOData trackIO[DRUMS];
+
+  // Only hits starting in [hitsFrom, hitsUntil) sound, in frames since
+  // init(), so an export chunk can play its part of the session
+  int64_t blockStart = 0;
+  int64_t hitsFrom = 0;
+  int64_t hitsUntil = INT64_MAX;
+
+  engine::VoiceCounter voices; // pool occupancy, updated every block
+
+  // Voices are allocated once in init(), scheduling never allocates
+  engine::VoicePool<Kick> kicks;
+  engine::VoicePool<Hihat> hihats;
+  engine::VoicePool<Snare> snares;
+
+  // Grooves, expanded a bar at a time by the player on the audio thread
+  engine::PatternPlayer player;
+  int nextNoteId = 1 << 20; // clear of the keyboard's midi note ids
+  bool looping = false;
+
+  const engine::StepPattern backbeat = engine::StepPattern(110)
+      .row(KICK,  "x... .... x... ....", 100, 0.9, 0.4)
+      .row(SNARE, ".... x... .... x...", 0, 1, 0.1)
+      .row(HIHAT, "x.x. x.x. x.x. x.x.");
+
+  // backbeat with an extra kick every other bar
+  const engine::StepPattern backbeat4 = engine::StepPattern(110, 4)
+      .row(KICK,  "x... .... x... .... | x... .... x.x. .... | "
+                  "x... .... x... .... | x... .... x.x. ....", 100, 0.9, 0.4)
+      .row(SNARE, ".... x... .... x... | .... x... .... x... | "
+                  ".... x... .... x... | .... x... .... x...", 0, 1, 0.1)
+      .row(HIHAT, "x.x. x.x. x.x. x.x. | x.x. x.x. x.x. x.x. | "
+                  "x.x. x.x. x.x. x.x. | x.x. x.x. x.x. x.x.");
+
+  const engine::StepPattern house = engine::StepPattern(140)
+      .row(KICK,  "x... .... ..x. ..x.", 100, 0.9, 0.4)
+      .row(SNARE, ".... x... .... x...", 0, 1, 0.1)
+      .row(HIHAT, "..x. ..x. ..x. ..x.");
+
+  const engine::StepPattern reggaeton = engine::StepPattern(96)
+      .row(KICK,  "x... x... x... x...", 150, 0.9, 0.4)
+      .row(SNARE, "...x ..x. ...x ..x.", 0, 1, 0.1);
+
+  // Before audio starts, with gam::sampleRate() already set
+  void init(double sampleRate, int framesPerBuffer) {
+    initReverb(framesPerBuffer);
+    initVoices();
+    player.sampleRate(sampleRate);
+    mixer.prepare(framesPerBuffer);
+    for (al::AudioIOData& io : trackIO) {
+      io.framesPerSecond(sampleRate);
+      io.framesPerBuffer(framesPerBuffer);
+      io.channelsIn(0);
+      io.channelsOut(2);
+    }
+  }
+
+  // Voices are only taken when a hit starts, so these cover the overlap
+  // of decaying hits (a kick rings for ~0.3 s). Snares send to this kit's
+  // reverbSend, so a kit must stay where it is once initialised.
+  void initVoices() {
+    kicks.allocate(8, engine::steal_same_pitch);
+    hihats.allocate(8, engine::steal_oldest);
+    snares.allocate(8, engine::steal_oldest);
+    for (int i = 0; i < snares.size(); i++) snares.voice(i).mSend = &reverbSend;
+    // a stolen hit ramps to silence over its last block
+    kicks.fade([](Kick& voice) { voice.mAmp.parameter().set(0); });
+    hihats.fade([](Hihat& voice) { voice.mAmp.parameter().set(0); });
+    snares.fade([](Snare& voice) { voice.mAmp.parameter().set(0); });
+  }
+
+  void initReverb(int framesPerBuffer) {
+    reverb.resize(gam::FREEVERB);
+    reverb.decay(0.5); // Set decay length, in seconds
+    reverb.damping(0.2); // Set high-frequency damping factor in [0, 1]
+    reverbSend.prepare(framesPerBuffer);
+  }
+
+  // Audio thread: starts and stops this block's hits and renders each
+  // drum's voices into its bus (io itself is left alone)
+  void render(al::AudioIOData& io) {
+    int frames = io.framesPerBuffer();
+    auto startHit = [&](const engine::drum_hit& hit, int offset) {
+      int64_t frame = blockStart + offset;
+      if (frame < hitsFrom || frame >= hitsUntil) return engine::note_ref{nullptr, -1};
+      return startDrum(hit, offset);
+    };
+    auto releaseHit = [&](const engine::note_ref& note, int offset) { engine::releaseNote(note, offset); };
+
+    // Nothing sounds before an export chunk's first hit, only keep the
+    // grooves' place
+    if (blockStart + frames <= hitsFrom) {
+      player.process(frames, startHit, releaseHit);
+      blockStart += frames;
+      return;
+    }
+
+    reverbSend.prepare(frames);
+    mixer.prepare(frames);
+    player.process(frames, startHit, releaseHit);
+    // Every hit plays on a pool voice, the pools render them: the synth and
+    // its sequencer would lock their voice and event lists every block
+    renderTrack(KICK, kicks, frames);
+    renderTrack(HIHAT, hihats, frames);
+    renderTrack(SNARE, snares, frames);
+    voices.update(kicks.active() + hihats.active() + snares.active());
+    blockStart += frames;
+  }
+
+  // Audio thread, after render(): one reverb for all snares, run once over
+  // the summed send into the reverb bus
+  void renderReverb(int frames) {
+    float* wetL = mixer.left(reverbBus);
+    float* wetR = mixer.right(reverbBus);
+    for (int i = 0; i < frames; i++) {
+      float wet = reverb(reverbSend[i]);
+      reverbPan(wet, wetL[i], wetR[i]);
+    }
+    reverbSend.clear();
+  }
+
+  // Channels of a chunk's stems: each drum's bus, then the reverb send
+  static constexpr int stemChannels = 2 * DRUMS + 1;
+
+  // Renders key's session for seconds into a wav file like the app's
+  // serial render, cut into chunks of chunkSeconds rendered on workers
+  // threads at once (see engine::renderChunked). Each chunk plays on a
+  // fresh kit made here, with its hits ringing out for up to tailSeconds.
+  // This kit mixes: it sums the chunks' sends through its reverb and the
+  // buses through its mixer, then mix(io) is the rest of the app's
+  // onSound() after renderReverb(). So the file is the same for any
+  // number of workers; it differs from the serial render by the float
+  // order of hits overlapping across a chunk start, and where such hits
+  // would have stolen each other's voices.
+  template <class Mix>
+  engine::render_stats renderChunks(const std::string& path, double seconds, int key, int workers,
+                                    double chunkSeconds, double tailSeconds, Mix&& mix,
+                                    double sampleRate, int framesPerBuffer, int channels) {
+    return engine::renderChunked(
+        path, seconds, chunkSeconds, tailSeconds, workers, stemChannels,
+        [&](const engine::chunk_span& chunk) {
+          // voices join Gamma's domain when made, so never on a worker
+          std::unique_ptr<DrumKit> kit(new DrumKit);
+          kit->init(sampleRate, framesPerBuffer);
+          kit->hitsFrom = chunk.start;
+          kit->hitsUntil = chunk.end;
+          kit->playKey(key);
+          return [kit = std::move(kit), chunk, framesPerBuffer](float* stems) {
+            kit->renderChunk(chunk, stems, framesPerBuffer);
+          };
+        },
+        [&](const float* stems, al::AudioIOData& io) {
+          int frames = io.framesPerBuffer();
+          mixer.prepare(frames);
+          reverbSend.prepare(frames);
+          for (int drum = 0; drum < DRUMS; drum++) loadBus(drumBus[drum], stems + 2 * drum * frames, frames);
+          std::copy(stems + 2 * DRUMS * frames, stems + (2 * DRUMS + 1) * frames, reverbSend.data());
+          renderReverb(frames);
+          mix(io);
+        },
+        sampleRate, framesPerBuffer, channels);
+  }
+
+  // Drum keys of the demo, returns false if key plays nothing here
+  bool playKey(int key) {
+    switch (key) {
+      // testing grounds
+      case 'e': playSnare(0.2); return true;
+      case 'w': playSnare(2); return true;
+      case 'q': playKick(150); return true;
+
+      case '1': playKick(50); return true;
+      case '2': playKick(100); return true;
+      case '3': playKick(150); return true;
+      case '4': playKick(200); return true;
+      case '5': playKick(250); return true;
+      case '6': playKick(300); return true;
+
+      case 'g': player.play(reggaeton); return true;
+      case 'd': player.play(backbeat); return true;
+      case 'a': player.play(backbeat4); return true;
+      case 'h': player.play(house, 4); return true;
+
+      // loop the house groove until pressed again
+      case 'l':
+        if (looping) player.stop();
+        else player.play(house, 0);
+        looping = !looping;
+        return true;
+    }
+    return false;
+  }
+
+  // Starts a drum hit offset frames into the current block (audio thread)
+  // returns the started note, with no voice if the pool had none for it
+  engine::note_ref startDrum(const engine::drum_hit& hit, int offset) {
+    switch (hit.instrument) {
+      case KICK:
+        if (Kick* kick = kicks.acquire(hit.pitch)) {
+          kick->mFreq->set(hit.pitch);
+          kick->mAmp.parameter().set(hit.amp);
+          return {kick, kicks.triggerOn(kick, offset, nextNoteId++)};
+        }
+        break;
+      case HIHAT:
+        if (Hihat* hihat = hihats.acquire()) {
+          hihat->mAmp.parameter().set(hit.amp);
+          return {hihat, hihats.triggerOn(hihat, offset, nextNoteId++)};
+        }
+        break;
+      case SNARE:
+        if (Snare* snare = snares.acquire()) {
+          snare->mAmp.parameter().set(hit.amp);
+          return {snare, snares.triggerOn(snare, offset, nextNoteId++)};
+        }
+        break;
+    }
+    return {nullptr, -1};
+  }
+
+  void playKick(float freq, float duration = 0.4, float amp = 0.9)
+  {
+      player.hit({KICK, freq, amp, duration});
+  }
+
+  void playHihat(float duration = 0.3)
+  {
+      player.hit({HIHAT, 0, 1, duration});
+  }
+
+  void playSnare(float duration = 0.3)
+  {
+      player.hit({SNARE, 0, 1, duration});
+  }
+
+ private:
+  template <class Voice>
+  void renderTrack(int drum, engine::VoicePool<Voice>& pool, int frames) {
+    al::AudioIOData& io = trackIO[drum];
+    io.zeroOut();
+    pool.render(io);
+    std::copy(io.outBuffer(0), io.outBuffer(0) + frames, mixer.left(drumBus[drum]));
+    std::copy(io.outBuffer(1), io.outBuffer(1) + frames, mixer.right(drumBus[drum]));
+  }
+
+  // Worker: renders a chunk of key's session on this fresh kit (see
+  // renderChunks()), its stems from chunk.start on, a block at a time
+  void renderChunk(const engine::chunk_span& chunk, float* stems, int framesPerBuffer) {
+    al::AudioIOData io;
+    io.framesPerBuffer(framesPerBuffer);
+    io.channelsIn(0);
+    io.channelsOut(2);
+    for (int64_t frame = 0; frame < chunk.stop; frame += framesPerBuffer) {
+      render(io);
+      if (frame < chunk.start) continue;
+      float* out = stems + (frame - chunk.start) / framesPerBuffer * stemChannels * framesPerBuffer;
+      for (int drum = 0; drum < DRUMS; drum++) copyBus(drumBus[drum], out + 2 * drum * framesPerBuffer, framesPerBuffer);
+      std::copy(reverbSend.data(), reverbSend.data() + framesPerBuffer, out + 2 * DRUMS * framesPerBuffer);
+      reverbSend.clear();
+      // the rest of stems is silence once the chunk's hits are done
+      if (frame + framesPerBuffer >= chunk.end && voices.active() == 0) break;
+    }
+  }
+
+  void copyBus(int bus, float* out, int frames) {
+    std::copy(mixer.left(bus), mixer.left(bus) + frames, out);
+    std::copy(mixer.right(bus), mixer.right(bus) + frames, out + frames);
+  }
+
+  void loadBus(int bus, const float* in, int frames) {
+    std::copy(in, in + frames, mixer.left(bus));
+    std::copy(in + frames, in + 2 * frames, mixer.right(bus));
+  }
+};
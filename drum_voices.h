@@ -0,0 +1,224 @@
+#pragma once
+
+// Drum voices of Drum_Demo, in a header so the benchmarks can run them
+// without the app
+
+#include "Gamma/Effects.h"
+#include "Gamma/Envelope.h"
+#include "Gamma/Gamma.h"
+#include "Gamma/Oscillator.h"
+
+#include "al/scene/al_PolySynth.hpp"
+#include "al/ui/al_Parameter.hpp"
+
+#include "audio_engine/auxbus.h"
+#include "audio_engine/block.h"
+#include "audio_engine/params.h"
+#include "audio_engine/silence.h"
+
+class Kick : public al::SynthVoice {
+ public:
+  // Unit generators
+  gam::Pan<> mPan;
+  gam::Sine<> mOsc;
+  gam::Decay<> mDecay; // Added decay envelope for pitch
+  gam::AD<> mAmpEnv; // Changed amp envelope from Env<3> to AD<>
+
+  // Parameter handles, resolved once in init()
+  engine::SmoothedParameter mAmp;
+  al::Parameter* mFreq;
+
+  bool mReleasing = false; // note off waiting for its frame
+
+  void init() override {
+    // Intialize amplitude envelope
+    // - Minimum attack (to make it thump)
+    // - Short decay
+    // - Maximum amplitude
+    mAmpEnv.attack(0.01);
+    mAmpEnv.decay(0.3);
+    mAmpEnv.amp(1.0);
+
+    // Initialize pitch decay 
+    mDecay.decay(0.3);
+
+    mAmp.bind(createInternalTriggerParameter("amplitude", 0.3, 0.0, 1.0));
+    mFreq = &createInternalTriggerParameter("frequency", 60, 20, 5000);
+  }
+
+  // The audio processing function
+  void onProcess(al::AudioIOData& io) override {
+    mOsc.freq(mFreq->get());
+    mPan.pos(0);
+    // (removed parameter control for attack and release)
+
+    float gainL, gainR;
+    engine::panGains(mPan, gainL, gainR);
+
+    // amplitude can change mid-note, so ramp it across the block
+    mAmp.beginBlock(io.framesPerBuffer());
+    int releaseFrame = mReleasing ? getEndOffsetFrames(io.framesPerBuffer()) : -1;
+    auto release = [&] { mAmpEnv.release(); mDecay.finish(); mReleasing = false; };
+    engine::processBlock(io, releaseFrame, release, [&](const engine::block_span& b) {
+      float decay[engine::blockChunk], osc[engine::blockChunk], env[engine::blockChunk], amp[engine::blockChunk];
+      for (int i = 0; i < b.frames; i++) decay[i] = mDecay();
+      for (int i = 0; i < b.frames; i++) {
+        mOsc.freqMul(decay[i]); // Multiply pitch oscillator by next decay value
+        osc[i] = mOsc();
+      }
+      for (int i = 0; i < b.frames; i++) env[i] = mAmpEnv();
+      for (int i = 0; i < b.frames; i++) amp[i] = mAmp.next();
+
+      for (int i = 0; i < b.frames; i++) osc[i] = osc[i] * env[i] * amp[i];
+      engine::mixPanned(b, osc, gainL, gainR);
+    });
+
+    if (mAmpEnv.done()) free();
+  }
+
+  // every hit starts from the same state, whatever the voice played before
+  void onTriggerOn() override { mOsc.phase(0); mAmpEnv.reset(); mDecay.reset(); mAmp.snap(); mReleasing = false; }
+
+  // released in onProcess() on the note off's frame
+  void onTriggerOff() override { mReleasing = true; }
+};
+
+/* ---------------------------------------------------------------- */
+
+class Hihat : public al::SynthVoice {
+ public:
+  // Unit generators
+  gam::Pan<> mPan;
+  
+  gam::Burst mBurst; // Resonant noise with exponential decay
+  gam::Burst mBurstStart; // mBurst as made, so every hit's noise is the same
+  engine::SilenceDetector mDone; // Burst has no done(), so watch its output
+
+  engine::SmoothedParameter mAmp;
+
+  void init() override {
+    // Initialize burst - Main freq, filter freq, duration
+    mBurst = gam::Burst(20000, 15000, 0.05);
+    mBurstStart = mBurst;
+
+    // Done once quieter than -80 dB for 5 ms, or 5x the burst length at most
+    mDone.set(1e-4, 0.005, 0.25);
+
+    mAmp.bind(createInternalTriggerParameter("amplitude", 1.0, 0.0, 1.0));
+  }
+
+  // The audio processing function
+  void onProcess(al::AudioIOData& io) override {
+    float gainL, gainR;
+    engine::panGains(mPan, gainL, gainR);
+
+    mAmp.beginBlock(io.framesPerBuffer());
+    engine::processBlock(io, [&](const engine::block_span& b) {
+      float noise[engine::blockChunk], amp[engine::blockChunk];
+      for (int i = 0; i < b.frames; i++) noise[i] = mBurst();
+      for (int i = 0; i < b.frames; i++) amp[i] = mAmp.next();
+      for (int i = 0; i < b.frames; i++) noise[i] *= amp[i];
+      mDone.process(noise, b.frames);
+      engine::mixPanned(b, noise, gainL, gainR);
+    });
+    if (mDone.done()) free();
+  }
+  void onTriggerOn() override { mBurst = mBurstStart; mBurst.reset(); mDone.reset(gam::sampleRate()); mAmp.snap(); }
+  //void onTriggerOff() override {  }
+};
+
+/* ---------------------------------------------------------------- */
+
+class Snare : public al::SynthVoice {
+ public:
+  // Unit generators
+  gam::Pan<> mPan;
+  gam::AD<> mAmpEnv; // Amplitude envelope
+  gam::Sine<> mOsc; // Main pitch osc (top of drum)
+  gam::Sine<> mOsc2; // Secondary pitch osc (bottom of drum)
+  gam::Decay<> mDecay; // Pitch decay for oscillators
+  gam::Burst mBurst; // Noise to simulate rattle/chains
+  gam::Burst mBurstStart; // mBurst as made, so every hit's noise is the same
+
+  engine::SmoothedParameter mAmp;
+  bool mReleasing = false; // note off waiting for its frame
+
+  // Reverb send the voice adds its output to, owned by whoever plays it
+  // (DrumKit sets it on each pooled snare). Its owner runs one reverb over
+  // it per block, so reverb cost doesn't grow with the number of snares.
+  engine::AuxBus* mSend = nullptr;
+
+  void init() override {
+    // Initialize burst 
+    mBurst = gam::Burst(10000, 5000, 0.3);
+    mBurstStart = mBurst;
+
+    // Initialize amplitude envelope
+    mAmpEnv.attack(0.01);
+    mAmpEnv.decay(0.01);
+    mAmpEnv.amp(1.0);
+
+    // Initialize pitch decay 
+    mDecay.decay(0.8);
+
+    mAmp.bind(createInternalTriggerParameter("amplitude", 1.0, 0.0, 1.0));
+  }
+
+  // The audio processing function
+  void onProcess(al::AudioIOData& io) override {
+    mOsc.freq(200);
+    mOsc2.freq(150);
+
+    float gainL, gainR;
+    engine::panGains(mPan, gainL, gainR);
+
+    mAmp.beginBlock(io.framesPerBuffer());
+    int releaseFrame = mReleasing ? getEndOffsetFrames(io.framesPerBuffer()) : -1;
+    auto release = [&] { mAmpEnv.release(); mDecay.finish(); mReleasing = false; };
+    engine::processBlock(io, releaseFrame, release, [&](const engine::block_span& b) {
+      float osc[engine::blockChunk], osc2[engine::blockChunk];
+      float env[engine::blockChunk], noise[engine::blockChunk], gain[engine::blockChunk];
+      float decay[engine::blockChunk];
+      // Each mDecay() call moves it forward (I think), so we only want
+      // to call it once per sample
+      for (int i = 0; i < b.frames; i++) decay[i] = mDecay();
+      for (int i = 0; i < b.frames; i++) {
+        mOsc.freqMul(decay[i]);
+        osc[i] = mOsc();
+      }
+      for (int i = 0; i < b.frames; i++) {
+        mOsc2.freqMul(decay[i]);
+        osc2[i] = mOsc2();
+      }
+      for (int i = 0; i < b.frames; i++) env[i] = mAmpEnv();
+      for (int i = 0; i < b.frames; i++) noise[i] = mBurst();
+      for (int i = 0; i < b.frames; i++) gain[i] = mAmp.next();
+
+      for (int i = 0; i < b.frames; i++) {
+        float amp = env[i];
+        noise[i] = (noise[i] + (osc[i] * amp * 0.1) + (osc2[i] * amp * 0.05)) * gain[i];
+      }
+      if (mSend) {
+        float* send = mSend->data() + b.start; // wet signal is mixed in by the send's owner
+        for (int i = 0; i < b.frames; i++) send[i] += noise[i];
+      }
+      engine::mixPanned(b, noise, gainL, gainR);
+    });
+    
+    if (mAmpEnv.done()) free();
+  }
+  // every hit starts from the same state, whatever the voice played before
+  void onTriggerOn() override {
+    mOsc.phase(0);
+    mOsc2.phase(0);
+    mBurst = mBurstStart;
+    mBurst.reset();
+    mAmpEnv.reset();
+    mDecay.reset();
+    mAmp.snap();
+    mReleasing = false;
+  }
+  
+  // released in onProcess() on the note off's frame
+  void onTriggerOff() override { mReleasing = true; }
+};
@@ -187,13 +187,13 @@ class MyApp : public App {
                 else{
                   cin >> inv;
                   std::vector<Note> chord;
-                  if(name=="Maj") chord = n.chord(Note::Maj, inv);
-                  if(name=="min") chord = n.chord(Note::min, inv);
-                  if(name=="Dim") chord = n.chord(Note::Dim, inv);
-                  if(name=="Aug") chord = n.chord(Note::Aug, inv);
-                  if(name=="Maj7") chord = n.chord(Note::Maj7, inv);
-                  if(name=="min7") chord = n.chord(Note::min7, inv);
-                  if(name=="Dom7") chord = n.chord(Note::Dom7, inv);
+                  if(name=="Maj") chord = n.chord(Note::Maj, inv).toVector();
+                  if(name=="min") chord = n.chord(Note::min, inv).toVector();
+                  if(name=="Dim") chord = n.chord(Note::Dim, inv).toVector();
+                  if(name=="Aug") chord = n.chord(Note::Aug, inv).toVector();
+                  if(name=="Maj7") chord = n.chord(Note::Maj7, inv).toVector();
+                  if(name=="min7") chord = n.chord(Note::min7, inv).toVector();
+                  if(name=="Dom7") chord = n.chord(Note::Dom7, inv).toVector();
 
                   cout << endl << n.name() << " " << name << " chord: ";
                   for(int i=0; i<chord.size(); i++){
@@ -215,7 +215,7 @@ class MyApp : public App {
   }
 
   void printScale(Note root, Note::scale_type type, char format='s'){
-    std::vector<Note> scale = root.scale(type);
+    std::vector<Note> scale = root.scale(type).toVector();
     std::string name;
     switch(type){
       case Note::Major:
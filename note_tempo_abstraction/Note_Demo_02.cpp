@@ -1,4 +1,6 @@
+#include <cfloat>
 #include <cstdio> // for printing to stdout
+#include <thread>
 
 #include "Gamma/Analysis.h"
 #include "Gamma/Effects.h"
@@ -12,8 +14,13 @@
 #include "al/ui/al_ControlGUI.hpp"
 #include "al/ui/al_Parameter.hpp"
 
+#include "../audio_engine/offline.h"
+#include "../audio_engine/profiler.h"
+#include "../audio_engine/rtguard.h"
+
 #include "note.h"
-#include "tempo.h"
+#include "noteplayer.h"
+#include "squarewave.h"
 
 // using namespace gam;
 using namespace al;
@@ -29,87 +36,32 @@ using namespace theory;
 // define the synth's voice parameters and the sound and graphic generation
 // processes in the onProcess() functions.
 
-class SquareWave : public SynthVoice
+// We make an app.
+class MyApp : public App
 {
 public:
-  // Unit generators
-  gam::Pan<> mPan;
-  gam::Sine<> mOsc1;
-  gam::Sine<> mOsc3;
-  gam::Sine<> mOsc5;
-  gam::Sine<> mOsc7;
-
-  gam::Env<3> mAmpEnv;
-
-  // Initialize voice. This function will only be called once per voice when
-  // it is created. Voices will be reused if they are idle.
-  void init() override
+  // Queued notes, their voices and the render threads, everything
+  // onSound() plays
+  NotePlayer player;
+  int renderThreads = 1;
+
+  // onSound() timing against the block deadline, stages in onSound() order
+  engine::BlockProfiler profiler;
+  engine::VoiceCounter voiceCount;
+  enum
   {
-    // Intialize envelope
-    mAmpEnv.curve(0); // make segments lines
-    mAmpEnv.levels(0, 1, 1, 0);
-    mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
-
-    createInternalTriggerParameter("amplitude", 0.8, 0.0, 1.0);
-    createInternalTriggerParameter("frequency", 440, 20, 5000);
-    createInternalTriggerParameter("attackTime", 0.1, 0.01, 3.0);
-    createInternalTriggerParameter("releaseTime", 0.1, 0.1, 10.0);
-    createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
-  }
+    STAGE_EVENTS,
+    STAGE_RENDER
+  };
 
-  // The audio processing function
-  void onProcess(AudioIOData &io) override
+  void onInit() override
   {
-    // Get the values from the parameters and apply them to the corresponding
-    // unit generators. You could place these lines in the onTrigger() function,
-    // but placing them here allows for realtime prototyping on a running
-    // voice, rather than having to trigger a new voice to hear the changes.
-    // Parameters will update values once per audio callback because they
-    // are outside the sample processing loop.
-    float f = getInternalParameterValue("frequency");
-    mOsc1.freq(f);
-    mOsc3.freq(f * 3);
-    mOsc5.freq(f * 5);
-    mOsc7.freq(f * 7);
-
-    float a = getInternalParameterValue("amplitude");
-    mAmpEnv.lengths()[0] = getInternalParameterValue("attackTime");
-    mAmpEnv.lengths()[2] = getInternalParameterValue("releaseTime");
-    mPan.pos(getInternalParameterValue("pan"));
-    while (io())
-    {
-      float s1 = mAmpEnv() * (mOsc1() * a +
-                              mOsc3() * (a / 3.0) +
-                              mOsc5() * (a / 5.0) +
-                              mOsc7() * (a / 7.0));
-
-      float s2;
-      mPan(s1, s1, s2);
-      io.out(0) += s1;
-      io.out(1) += s2;
-    }
-    // We need to let the synth know that this voice is done
-    // by calling the free(). This takes the voice out of the
-    // rendering chain
-    if (mAmpEnv.done())
-      free();
-  }
-
-  // The triggering functions just need to tell the envelope to start or release
-  // The audio processing function checks when the envelope is done to remove
-  // the voice from the processing chain.
-  void onTriggerOn() override { mAmpEnv.reset(); }
-  void onTriggerOff() override { mAmpEnv.release(); }
-};
+    // Set sampling rate for Gamma objects from app's audio
+    gam::sampleRate(audioIO().framesPerSecond());
 
-// We make an app.
-class MyApp : public App
-{
-public:
-  // GUI manager for SquareWave voices
-  // The name provided determines the name of the directory
-  // where the presets and sequences are stored
-  SynthGUIManager<SquareWave> synthManager{"SquareWave"};
+    player.init(audioIO().framesPerSecond(), audioIO().framesPerBuffer(), renderThreads);
+    profiler.deadline(audioIO().framesPerBuffer(), audioIO().framesPerSecond());
+  }
 
   // This function is called right after the window is created
   // It provides a grphics context to initialize ParameterGUI
@@ -120,38 +72,54 @@ public:
     navControl().active(false); // Disable navigation via keyboard, since we
                                 // will be using keyboard for note triggering
 
-    // Set sampling rate for Gamma objects from app's audio
-    gam::sampleRate(audioIO().framesPerSecond());
-
     imguiInit();
-
-    // Play example sequence. Comment this line to start from scratch
-    // synthManager.synthSequencer().playSequence("synth1.synthSequence");
-    synthManager.synthRecorder().verbose(true);
   }
 
   // The audio callback function. Called when audio hardware requires data
   void onSound(AudioIOData &io) override
   {
-    synthManager.render(io); // Render audio
+    engine::RtScope rt; // flags allocations and locks in -DENGINE_RT_GUARD builds
+    profiler.beginBlock();
+    player.events(io.framesPerBuffer());
+    profiler.endStage(STAGE_EVENTS);
+
+    player.render(io);
+    voiceCount.update(player.voices.active());
+    profiler.endStage(STAGE_RENDER);
+    profiler.endBlock(voiceCount.active());
   }
 
   void onAnimate(double dt) override
   {
     // The GUI is prepared here
     imguiBeginFrame();
-    // Draw a window that contains the synth control panel
-    synthManager.drawSynthControlPanel();
+    ImGui::Text("Notes: %d pending high water, %ld queue overflows",
+                player.noteStarts.highWater(), player.noteQueue.overflows());
+    if (ImGui::SliderInt("Render threads", &renderThreads, 1, player.renderer.maxPrepared()))
+      player.renderer.threads(renderThreads);
+    drawProfile();
     imguiEndFrame();
   }
 
+  // Block time histogram and deadline misses of onSound()
+  void drawProfile()
+  {
+    engine::profile_snapshot p = profiler.snapshot();
+    ImGui::Text("Audio: %.2f ms last, %.2f p99, %.2f max of %.2f ms, %ld/%ld blocks late",
+                p.lastNs * 1e-6, p.percentile(0.99) * 1e-6, p.maxNs * 1e-6, p.deadlineNs * 1e-6,
+                p.misses, p.blocks);
+    ImGui::Text("Events %.2f ms (max %.2f), render %.2f ms (max %.2f), %d voices (max %d)",
+                p.stageLastNs[STAGE_EVENTS] * 1e-6, p.stageMaxNs[STAGE_EVENTS] * 1e-6,
+                p.stageLastNs[STAGE_RENDER] * 1e-6, p.stageMaxNs[STAGE_RENDER] * 1e-6,
+                p.voices, p.maxVoices);
+    ImGui::PlotHistogram("Block time (log, up to 2 deadlines)", p.histogram, p.buckets, 0, nullptr,
+                         0, FLT_MAX, ImVec2(0, 60));
+  }
+
   // The graphics callback function.
   void onDraw(Graphics &g) override
   {
     g.clear();
-    // Render the synth's graphics
-    synthManager.render(g);
-
     // GUI is drawn here
     imguiDraw();
   }
@@ -165,138 +133,94 @@ public:
       return true;
     }
 
-    switch (k.key())
-    {
-    case 'a':
-      playHappyBirthday(Note("C4"), 90);
-      return false;
-    case 's':
-      playHappyBirthday(Note("G3"), 120);
-      return false;
-
-    
-    }
-
-    return true;
+    return playKey(k.key());
   }
 
-  // Whenever a key is released this function is called
-  bool
-  onKeyUp(Keyboard const &k) override
+  // Key handling, shared by the keyboard and offline rendering
+  bool playKey(int key)
   {
-    int midiNote = asciiToMIDI(k.key());
-    if (midiNote > 0)
-    {
-      synthManager.triggerOff(midiNote);
-    }
-    return true;
+    // a song key is used up, others go on to the GUI
+    return !player.playKey(key);
   }
 
   void onExit() override { imguiShutdown(); }
 
-  // New code: a function to play a note A
-
-  float playNote(float time, Note note, float duration = 0.5, float amp = 0.2, float attack = 0.1, float decay = 0.5)
+  // Renders the song on key as fast as possible into a wav file
+  void renderOffline(const char *path, double seconds, int key)
   {
-    auto *voice = synthManager.synth().getVoice<SquareWave>();
-    // amp, freq, attack, release, pan
-    voice->setTriggerParams({amp, note.frequency(), 0.1, 0.1, 0.0});
-    synthManager.synthSequencer().addVoiceFromNow(voice, time, duration*0.9);
-
-    return time+duration;
+    double sampleRate = audioIO().framesPerSecond();
+    onInit();
+    playKey(key);
+
+    engine::render_stats stats = engine::renderOffline(
+        path, seconds, [&](AudioIOData &io) { onSound(io); },
+        sampleRate, audioIO().framesPerBuffer(), audioIO().channelsOut());
+    printf("Rendered %.1f s in %.3f s (%.1fx realtime) to %s\n",
+           stats.audioSeconds, stats.wallSeconds, stats.realtimeFactor(), path);
+    printf("Notes: %ld queue overflows, %d voices high water, %ld steals\n",
+           player.noteQueue.overflows(), player.voices.highWater(), player.voices.steals());
+    engine::profile_snapshot p = profiler.snapshot();
+    printf("Blocks: %.3f ms p50, %.3f ms p99, %.3f ms max of %.3f ms, %ld/%ld late\n",
+           p.percentile(0.5) * 1e-6, p.percentile(0.99) * 1e-6, p.maxNs * 1e-6,
+           p.deadlineNs * 1e-6, p.misses, p.blocks);
   }
 
-  float playChord(float time, std::vector<Note> chord, float duration, bool roll=false){
-      float localTime = 0;
-      for(int i=0; i<chord.size(); i++){
-          playNote(time+localTime, chord[i], duration, 0.05, 0.2, 0.75);
-          if(roll) localTime += duration / 32;
-      }
-      return time+duration;
-  }
-
-  void playHappyBirthday(Note root, float bpm)
+  // Plays every key's song under the real-time guard (build with
+  // -DENGINE_RT_GUARD), returns the number of violations found
+  long rtCheck(double seconds)
   {
-    
-    // Happy birthday uses: P1(C), M2(D), M3(E), P4(F), P5(G), M6(A), and m7(Bb)
-    notelist majScale = scale(root, scaleT::Major);
-    Note M2 = scale_degree(majScale, degree::II);
-    Note M3 = scale_degree(majScale, degree::III);
-    Note P4 = scale_degree(majScale, degree::IV);
-    Note P5 = scale_degree(majScale, degree::V);
-    Note M6 = scale_degree(majScale, degree::VI);
-    Note m7 = root.interval(intervalT::m7);
-    Note P8 = scale_degree(majScale, degree::VIII);
-
-    // For chords it needs: F Maj, C Dom7, Bb Maj, F/C (2nd inversion)
-    // (Also dropping the root of the chord down an octave or Perfect Eighth)
-    notelist chord1 = chord(P4.interval(12), "maj");
-    notelist chord2 = root.chord("7");
-    notelist chord3 = chord(m7.interval(-12), "maj");
-    notelist chord4 = chord("F/C"); // 2nd inversion
-
-    // Now lets set up a tempo
-    //  syntax: Tempo(bpm, timeSig top, timeSig bottom)
-    float time = 0;
-    Tempo tpo(bpm, 3, 4); 
-    // this allows us to say get exact durations for common note types
-
-    time = playNote(time, root, tpo.duration(Tempo::eighth, true)); // true = dotted note
-    time = playNote(time, root, tpo.duration(Tempo::sixteenth)); 
-
-    playChord(time, chord1, tpo.duration(Tempo::half));
-    time = playNote(time, M2, tpo.duration(Tempo::quarter)); 
-    time = playNote(time, root, tpo.duration(Tempo::quarter)); 
-    time = playNote(time, P4, tpo.duration(Tempo::quarter)); 
-
-    playChord(time, chord2, tpo.duration(Tempo::half));
-    time = playNote(time, M3, tpo.duration(Tempo::half)); 
-    time = playNote(time, root, tpo.duration(Tempo::eighth, true)); // true = dotted note
-    time = playNote(time, root, tpo.duration(Tempo::sixteenth));
-
-    time = playNote(time, M2, tpo.duration(Tempo::q)); 
-    time = playNote(time, root, tpo.duration(Tempo::q)); 
-    time = playNote(time, P5, tpo.duration(Tempo::q)); 
-
-    playChord(time, chord1, tpo.duration(Tempo::h));
-    time = playNote(time, P4, tpo.duration(Tempo::h)); 
-    time = playNote(time, root, tpo.duration(Tempo::e, true)); 
-    time = playNote(time, root, tpo.duration(Tempo::s));
-
-    time = playNote(time, P8, tpo.duration(Tempo::q)); 
-    time = playNote(time, M6, tpo.duration(Tempo::q)); 
-    time = playNote(time, P4, tpo.duration(Tempo::q)); 
-
-    playChord(time, chord3, tpo.duration(Tempo::h));
-    time = playNote(time, M3, tpo.duration(Tempo::q)); 
-    time = playNote(time, M2, tpo.duration(Tempo::q)); 
-    time = playNote(time, m7, tpo.duration(Tempo::e, true));
-    time = playNote(time, m7, tpo.duration(Tempo::s));
-
-    playChord(time, chord4, tpo.duration(Tempo::h));
-    time = playNote(time, M6, tpo.duration(Tempo::q)); 
-    time = playNote(time, P4, tpo.duration(Tempo::q)); 
-    playChord(time, chord2, tpo.duration(Tempo::q));   
-    time = playNote(time, P5, tpo.duration(Tempo::q));  
-
-    playChord(time, chord1, tpo.duration(Tempo::h));
-    time = playNote(time, P4, tpo.duration(Tempo::h)); 
+    double sampleRate = audioIO().framesPerSecond();
+    onInit();
+    engine::rtGuardInstall();
 
+    for (const char *key = "as"; *key; key++)
+    {
+      playKey(*key);
+      engine::renderBlocks(
+          seconds, [&](AudioIOData &io) { onSound(io); }, [](AudioIOData &, int) {},
+          sampleRate, audioIO().framesPerBuffer(), audioIO().channelsOut());
+    }
+    engine::rt_violations v = engine::rtViolations();
+    printf("Real-time guard: %ld allocations, %ld locks, %ld iostream writes on the audio thread\n",
+           v.allocations, v.locks, v.iostream);
+    return v.total();
   }
 
+};
 
-
-  };
-
-  
-
-int main()
+int main(int argc, char *argv[])
 {
   // Create app instance
   MyApp app;
 
+  // Offline render, no window or audio device:
+  //   Note_Demo_02 --render out.wav [seconds] [key] [block size] [render threads]
+  // Real-time safety check of every key, in a -DENGINE_RT_GUARD build:
+  //   Note_Demo_02 --rt-check [seconds per key]
+  bool render = argc > 2 && std::string(argv[1]) == "--render";
+  bool rtCheck = argc > 1 && std::string(argv[1]) == "--rt-check";
+
   // Set up audio
-  app.configureAudio(48000., 512, 2, 0);
+  app.configureAudio(48000., render && argc > 5 ? atoi(argv[5]) : 512, 2, 0);
+
+  if (render)
+  {
+    double seconds = argc > 3 ? atof(argv[3]) : 20;
+    int key = argc > 4 ? argv[4][0] : 'a';
+    app.renderThreads = argc > 6 ? atoi(argv[6]) : 1;
+    app.renderOffline(argv[2], seconds, key);
+    return 0;
+  }
+
+  if (rtCheck)
+  {
+    if (!engine::rtguard::enabled)
+    {
+      printf("Build with -DENGINE_RT_GUARD to check real-time safety\n");
+      return 2;
+    }
+    return app.rtCheck(argc > 2 ? atof(argv[2]) : 10) ? 1 : 0;
+  }
 
   app.start();
 
@@ -5,11 +5,66 @@
 #include <stdio.h>
 #include <ostream>
 #include <assert.h>  
-#include <regex>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <initializer_list>
 
 #include "notehelpers.h"
 
 namespace theory {
+
+/*
+    FixedList: vector-like list with inline storage (never touches the allocator)
+        used for chords (<= 8 notes) and scales (<= scale_type::maxLength notes)
+*/
+template <typename T, int Capacity>
+class FixedList {
+    static_assert(std::is_trivially_copyable<T>::value, "FixedList stores raw copies");
+
+    public:
+        FixedList(){}
+        FixedList(std::initializer_list<T> list){
+            for(const T& t:list) push_back(t);
+        }
+
+        void push_back(const T& t){
+            if(mSize >= Capacity){
+                throw std::out_of_range("FixedList : capacity ("+std::to_string(Capacity)+") exceeded");
+            }
+            new (data()+mSize) T(t);
+            mSize++;
+        }
+        void pop_back(){ mSize--; }
+        void clear(){ mSize = 0; }
+
+        int size() const { return mSize; }
+        bool empty() const { return mSize == 0; }
+        static constexpr int capacity(){ return Capacity; }
+
+        T* data(){ return reinterpret_cast<T*>(mStorage); }
+        const T* data() const { return reinterpret_cast<const T*>(mStorage); }
+
+        T& operator[](int i){ return data()[i]; }
+        const T& operator[](int i) const { return data()[i]; }
+        T& front(){ return data()[0]; }
+        T& back(){ return data()[mSize-1]; }
+
+        T* begin(){ return data(); }
+        T* end(){ return data()+mSize; }
+        const T* begin() const { return data(); }
+        const T* end() const { return data()+mSize; }
+
+        // copy for call sites that still take std::vector (allocates)
+        std::vector<T> toVector() const { return std::vector<T>(begin(), end()); }
+
+    private:
+        alignas(T) unsigned char mStorage[sizeof(T)*Capacity];
+        int mSize = 0;
+};
+
 /*------------------------------------------------------------------------------
 
 Note - an music theory abstraction for high-level composition
@@ -36,6 +91,8 @@ Note - an music theory abstraction for high-level composition
             > (string) "Eb"
 
         note.frequency() 
+        note.frequency(float root)
+        note.frequency(frequency_table)
             > (float) 622.254
         
         note.distanceTo(note2)       
@@ -77,6 +134,10 @@ Note - an music theory abstraction for high-level composition
         scale(string tonic_name, scale_type)             
             > returns scale (notelist)
         
+        inScale(Note tonic, scale_type, Note note)
+        inChord(Note root, string chord_name, Note note)
+            > returns true if note's pitch class is in the scale/chord
+
         scale_degree(notelist scale, scale_degree)
         scale_degree(notelist scale, int degree)
             > returns Note
@@ -90,16 +151,18 @@ Note - an music theory abstraction for high-level composition
 class Note {
     public:
         char signPref;
-        int index;
+        uint8_t index;  // midi [0, 127], Note packs into 2 bytes
 
-        typedef std::vector<Note> notelist;
+        // chords and scales are returned inline, largest is a full chromatic scale
+        typedef FixedList<Note, scale_type::maxLength> NoteSet;
+        typedef NoteSet notelist;
 
         //  constructor
         Note(char note='A', char sign='n', int octave=4, char signPref='b'){ 
             helper::parsed_str parsed = {note, sign, octave};
             init(helper::parsedToMidi(parsed), signPref);
         }
-        Note(std::string input, char signPref='n'){ this->set(input, signPref); }
+        Note(std::string_view input, char signPref='n'){ this->set(input, signPref); }
         Note(int midi, char signPref='b'){ init(midi, signPref); }
 
         // Main initializer
@@ -133,10 +196,12 @@ class Note {
 
         // returns frequency (based on root)
         float frequency(float root=440.0){
-            int distance = this->index - 69;
-            double multiplier = pow(2.0, 1.0/12);
+            return helper::frequencyTable(root)[this->index];
+        }
 
-            return (float)(root*pow(multiplier, distance));
+        // returns frequency from a precomputed table, e.g. helper::a440
+        float frequency(const helper::frequency_table& table){
+            return table[this->index];
         }
 
         // returns octave [-1, 9]
@@ -152,7 +217,7 @@ class Note {
         void set(int midi, char signPref='b'){ init(midi, signPref); }
 
         // set note to new string name
-        void set(std::string input, char signPref='n')
+        void set(std::string_view input, char signPref='n')
         { 
             helper::parsed_str parsed = helper::parseString(input);
             int idx = helper::parsedToMidi(parsed);
@@ -171,7 +236,7 @@ class Note {
 
         // set octave of note without changing key
         bool setOctave(int octave=4){
-            if(octave < -1 && octave > 9) return false;
+            if(octave < -1 || octave > 9) return false;
             int noteIdx = this->index%12;
             int offset = (octave+1)*12;
             this->index = noteIdx + offset;
@@ -297,6 +362,8 @@ class Note {
 
 };
 
+static_assert(sizeof(Note) == 2, "Note should stay a packed value type");
+
 // ------------------------------------------------------------------
 //      Static Methods
 // ------------------------------------------------------------------     
@@ -325,86 +392,52 @@ class Note {
         return chord;
     }
 
-    static Note::notelist chord(Note* root, std::string name, int octave=3){
+    // builds chord from a compiled pattern on rootIdx, applying figured bass
+    static Note::notelist buildChord(const helper::chord_pattern& pattern, int rootIdx, int inversion){
         Note::notelist ret;
 
-        helper::parsed_chord parsed = helper::parseChord(name);
-        Note rt = Note(root->midi());
-        rt.setOctave(octave);
-        int rootIdx = rt.midi();
-
-        for(int interval:parsed.intervals){
+        for(int interval:pattern.parsed.intervals){
             ret.push_back(Note(rootIdx + interval));
         }
 
-        if(parsed.bass != parsed.key){
-            int bassNote = helper::noteIndex(parsed.bass);
-            int bassIdx = -1;
-            for(int i=0; i<ret.size(); i++){
-                int noteLoc = helper::noteIndex(ret[i].key());
-                if(noteLoc == bassNote){
-                    bassIdx = i;
-                }
-            }
-            if(bassIdx == -1){
-                throw std::out_of_range("Chord(string) : Figured bass ("+parsed.bass+") is not in chord");
-            }
-            else{
-                std::cout << "Inversion=" << bassIdx << std::endl;
-                ret = invertChord(ret, bassIdx);
+        if(pattern.hasBass){
+            if(inversion == -1){
+                throw std::out_of_range("Chord(string) : Figured bass ("+std::string(pattern.parsed.bass.view())+") is not in chord");
             }
-        }
-
-
-        std::cout << "\nNotes: ";
-        for(Note n:ret){
-            std::cout << n.key() << ", ";
+            ret = invertChord(ret, inversion);
         }
 
         return ret;
     }
 
-    static Note::notelist chord(std::string name, int octave=3){
-        Note::notelist ret;
-
-        helper::parsed_chord parsed = helper::parseChord(name);
-        Note root = Note(parsed.key+parsed.sign);
-        root.setOctave(octave);
-        int rootIdx = root.midi();
+    // chord symbol is parsed once and cached (see helper::chordCache())
+    static Note::notelist chord(Note* root, std::string_view name, int octave=3){
+        helper::chord_pattern pattern = helper::chordCache().get(name);
+        Note rt = Note(root->midi());
+        rt.setOctave(octave);
+        int rootIdx = rt.midi();
 
-        for(int interval:parsed.intervals){
-            ret.push_back(Note(rootIdx + interval));
-        }
-
-        if(parsed.bass != parsed.key){
-            int bassNote = helper::noteIndex(parsed.bass);
-            int bassIdx = -1;
-            for(int i=0; i<ret.size(); i++){
-                int noteLoc = helper::noteIndex(ret[i].key());
-                if(noteLoc == bassNote){
-                    bassIdx = i;
-                }
-            }
-            if(bassIdx == -1){
-                throw std::out_of_range("Chord(string) : Figured bass ("+parsed.bass+") is not in chord");
-            }
-            else{
-                std::cout << "Inversion=" << bassIdx << std::endl;
-                ret = invertChord(ret, bassIdx);
-            }
+        int inversion = pattern.inversion;
+        if(pattern.hasBass && rootIdx % 12 != pattern.rootClass){
+            inversion = helper::bassInversion(pattern, rootIdx);
         }
+        return buildChord(pattern, rootIdx, inversion);
+    }
 
+    static Note::notelist chord(Note root, std::string_view name, int octave=3){
+        return chord(&root, name, octave);
+    }
 
-        std::cout << "\nNotes: ";
-        for(Note n:ret){
-            std::cout << n.key() << ", ";
-        }
+    static Note::notelist chord(std::string_view name, int octave=3){
+        helper::chord_pattern pattern = helper::chordCache().get(name);
+        Note root = Note(pattern.parsed.key.view());
+        root.setOctave(octave);
 
-        return ret;
+        return buildChord(pattern, root.midi(), pattern.inversion);
     }
 
     Note::notelist Note::chord(std::string chord_name, int octave){
-        return theory::chord(this, octave);
+        return theory::chord(this, chord_name, octave);
     }
     
     // Returns chord (vector of notes) based on root name and chord type
@@ -463,11 +496,22 @@ class Note {
         return scale(Note(note), type);
     }
 
+    // returns true if note is in the scale built on tonic (any octave)
+    static bool inScale(Note tonic, scale_type::name type, Note note){
+        return helper::scaleSets[type].contains(note.midi() - tonic.midi());
+    }
+
+    // returns true if note is a tone of the chord built on root (any octave)
+    static bool inChord(Note root, std::string_view name, Note note){
+        return helper::chordCache().get(name).pitches.contains(note.midi() - root.midi());
+    }
+
 typedef interval_type::name intervalT;
 typedef scale_type::name scaleT;
 typedef scale_type::degree degree;
 typedef chord_type::quality qualityT;
 typedef Note::notelist notelist;
+typedef Note::NoteSet NoteSet;
 
 }
 
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include "note.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define NOTEBATCH_AVX2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define NOTEBATCH_NEON 1
+#endif
+
+/*
+    Batch midi -> frequency conversion
+
+        helper::midiToFrequency(const int* midi, float* out, int n, float root=440, const float* cents=nullptr)
+        theory::frequencies(const Note* notes, float* out, int n, float root=440, const float* cents=nullptr)
+        theory::frequencies(notelist notes, float* out, float root=440, const float* cents=nullptr)
+
+    out[i] = frequency of midi[i] for A4 = root, detuned by cents[i] (if given).
+    Midi indices are clamped to [0, 255].
+    Uses an AVX2 kernel (picked at runtime) on x86, NEON on arm64, scalar otherwise.
+    All kernels share the same exp2 polynomial, so results agree to within 1 ulp.
+    Notes without cents are plain table reads, the same values as Note::frequency().
+    Note arrays are gathered straight from the packed Notes on AVX2, which
+    beats a Note::frequency() loop with or without cents; without AVX2, only
+    the cents path is faster than the loop.
+*/
+namespace helper {
+
+    enum batch_kernel {
+        kernel_scalar, kernel_avx2, kernel_neon
+    };
+
+    // 2^x via rounding + degree 6 polynomial (relative error ~1e-7)
+    // x is clamped to [-126, 126] so the result stays a normal float
+    static float exp2Approx(float x){
+        x = std::min(std::max(x, -126.0f), 126.0f);
+        float n = std::nearbyint(x);
+        float f = x - n;
+        float p = 1.540353e-4f;
+        p = p*f + 1.333355e-3f;
+        p = p*f + 9.618129e-3f;
+        p = p*f + 5.550411e-2f;
+        p = p*f + 2.402265e-1f;
+        p = p*f + 6.931472e-1f;
+        p = p*f + 1.0f;
+        return std::ldexp(p, (int)n);
+    }
+
+    static void midiToFrequencyScalar(const int* midi, float* out, int n, const frequency_table& table, const float* cents){
+        for(int i=0; i<n; i++){
+            float freq = table[std::min(std::max(midi[i], 0), 255)];
+            if(cents) freq *= exp2Approx(cents[i] * (1.0f/1200));
+            out[i] = freq;
+        }
+    }
+
+#ifdef NOTEBATCH_AVX2
+    __attribute__((target("avx2")))
+    static inline __m256 exp2AVX2(__m256 x){
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+        __m256 n = _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 f = _mm256_sub_ps(x, n);
+        __m256 p = _mm256_set1_ps(1.540353e-4f);
+        p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.333355e-3f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(9.618129e-3f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(5.550411e-2f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(2.402265e-1f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(6.931472e-1f));
+        p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+
+        // 2^n built directly in the exponent bits
+        __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+    }
+
+    __attribute__((target("avx2")))
+    static void midiToFrequencyAVX2(const int* midi, float* out, int n, const frequency_table& table, const float* cents){
+        const __m256i lo = _mm256_setzero_si256();
+        const __m256i hi = _mm256_set1_epi32(255);
+        const __m256 perCent = _mm256_set1_ps(1.0f/1200);
+
+        int i = 0;
+        for(; i+8 <= n; i+=8){
+            __m256i idx = _mm256_loadu_si256((const __m256i*)(midi+i));
+            idx = _mm256_min_epi32(_mm256_max_epi32(idx, lo), hi);
+            __m256 freq = _mm256_i32gather_ps(table.hz, idx, 4);
+            if(cents){
+                __m256 octaves = _mm256_mul_ps(_mm256_loadu_ps(cents+i), perCent);
+                freq = _mm256_mul_ps(freq, exp2AVX2(octaves));
+            }
+            _mm256_storeu_ps(out+i, freq);
+        }
+        midiToFrequencyScalar(midi+i, out+i, n-i, table, cents ? cents+i : nullptr);
+    }
+
+    // Note's index is the high byte of each 2 byte Note, so 16 notes are
+    // one load and a shift away from two gathers (no index copy)
+    static_assert(offsetof(theory::Note, index) == 1, "notesToFrequencyAVX2 reads index as the high byte");
+
+    __attribute__((target("avx2")))
+    static void notesToFrequencyAVX2(const theory::Note* notes, float* out, int n, const frequency_table& table, const float* cents){
+        const __m256 perCent = _mm256_set1_ps(1.0f/1200);
+
+        int i = 0;
+        for(; i+16 <= n; i+=16){
+            __m256i idx = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i*)(notes+i)), 8);
+            __m256 lo = _mm256_i32gather_ps(table.hz, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(idx)), 4);
+            __m256 hi = _mm256_i32gather_ps(table.hz, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(idx, 1)), 4);
+            if(cents){
+                lo = _mm256_mul_ps(lo, exp2AVX2(_mm256_mul_ps(_mm256_loadu_ps(cents+i), perCent)));
+                hi = _mm256_mul_ps(hi, exp2AVX2(_mm256_mul_ps(_mm256_loadu_ps(cents+i+8), perCent)));
+            }
+            _mm256_storeu_ps(out+i, lo);
+            _mm256_storeu_ps(out+i+8, hi);
+        }
+        for(; i<n; i++){
+            float freq = table[notes[i].index];
+            if(cents) freq *= exp2Approx(cents[i] * (1.0f/1200));
+            out[i] = freq;
+        }
+    }
+#endif
+
+#ifdef NOTEBATCH_NEON
+    static inline float32x4_t exp2NEON(float32x4_t x){
+        x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-126.0f)), vdupq_n_f32(126.0f));
+        float32x4_t n = vrndnq_f32(x);
+        float32x4_t f = vsubq_f32(x, n);
+        float32x4_t p = vdupq_n_f32(1.540353e-4f);
+        p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(1.333355e-3f));
+        p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(9.618129e-3f));
+        p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(5.550411e-2f));
+        p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(2.402265e-1f));
+        p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(6.931472e-1f));
+        p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(1.0f));
+
+        int32x4_t e = vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127));
+        return vmulq_f32(p, vreinterpretq_f32_s32(vshlq_n_s32(e, 23)));
+    }
+
+    static void midiToFrequencyNEON(const int* midi, float* out, int n, const frequency_table& table, const float* cents){
+        const float32x4_t perCent = vdupq_n_f32(1.0f/1200);
+
+        int i = 0;
+        for(; i+4 <= n; i+=4){
+            // no gather on NEON, table loads stay scalar
+            float freqs[4];
+            for(int j=0; j<4; j++) freqs[j] = table[std::min(std::max(midi[i+j], 0), 255)];
+            float32x4_t freq = vld1q_f32(freqs);
+            if(cents){
+                float32x4_t octaves = vmulq_f32(vld1q_f32(cents+i), perCent);
+                freq = vmulq_f32(freq, exp2NEON(octaves));
+            }
+            vst1q_f32(out+i, freq);
+        }
+        midiToFrequencyScalar(midi+i, out+i, n-i, table, cents ? cents+i : nullptr);
+    }
+#endif
+
+    // returns fastest kernel supported by this cpu (checked once)
+    static batch_kernel batchKernel(){
+#if defined(NOTEBATCH_AVX2)
+        static const batch_kernel kernel = __builtin_cpu_supports("avx2") ? kernel_avx2 : kernel_scalar;
+        return kernel;
+#elif defined(NOTEBATCH_NEON)
+        return kernel_neon;
+#else
+        return kernel_scalar;
+#endif
+    }
+
+    // converts n midi indices to frequencies with the given kernel
+    // (falls back to scalar if the kernel is not available)
+    static void midiToFrequency(const int* midi, float* out, int n, batch_kernel kernel, float root=440.0f, const float* cents=nullptr){
+        const frequency_table& table = frequencyTable(root);
+        switch(kernel){
+#ifdef NOTEBATCH_AVX2
+            case kernel_avx2:
+                if(__builtin_cpu_supports("avx2")){
+                    midiToFrequencyAVX2(midi, out, n, table, cents);
+                    return;
+                }
+                break;
+#endif
+#ifdef NOTEBATCH_NEON
+            case kernel_neon:
+                midiToFrequencyNEON(midi, out, n, table, cents);
+                return;
+#endif
+            default:
+                break;
+        }
+        midiToFrequencyScalar(midi, out, n, table, cents);
+    }
+
+    // converts n midi indices to frequencies with the fastest kernel
+    static void midiToFrequency(const int* midi, float* out, int n, float root=440.0f, const float* cents=nullptr){
+        midiToFrequency(midi, out, n, batchKernel(), root, cents);
+    }
+}
+
+namespace theory {
+
+    // converts n notes to frequencies (see helper::midiToFrequency)
+    static void frequencies(const Note* notes, float* out, int n, float root=440.0f, const float* cents=nullptr){
+#ifdef NOTEBATCH_AVX2
+        if(helper::batchKernel() == helper::kernel_avx2){
+            helper::notesToFrequencyAVX2(notes, out, n, helper::frequencyTable(root), cents);
+            return;
+        }
+#endif
+        // elsewhere, without detune it is one table read per note, copying
+        // indices for the kernel only adds work
+        if(!cents){
+            const helper::frequency_table& table = helper::frequencyTable(root);
+            for(int i=0; i<n; i++) out[i] = table[notes[i].index];
+            return;
+        }
+        const int chunk = 256;
+        int midi[chunk];
+        for(int start=0; start<n; start+=chunk){
+            int count = std::min(chunk, n-start);
+            for(int i=0; i<count; i++) midi[i] = notes[start+i].index;
+            helper::midiToFrequency(midi, out+start, count, root, cents ? cents+start : nullptr);
+        }
+    }
+
+    // converts a chord or scale to frequencies, out must hold notes.size() floats
+    static void frequencies(const notelist& notes, float* out, float root=440.0f, const float* cents=nullptr){
+        frequencies(notes.data(), out, notes.size(), root, cents);
+    }
+}
@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <string>
+#include <string_view>
+#include <stdexcept>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
 #include <stdio.h>
 #include <ostream>
 #include <assert.h>  
-#include <regex>
 
 #include "noteconsts.h"
 
@@ -14,132 +19,165 @@ namespace helper{
         int octave;
     };
 
-    std::regex note_regex("[a-gA-G]");
-    std::regex sign_regex("[#nb]");
-    std::regex octave_regex("\\-1|[0-9]");
-
-    // takes string input
-    // returns {note, sign, octave} if valid
-    static parsed_str parseString(std::string str){
-        std::string toParse = str;
-        parsed_str ret;
+    enum parse_status {
+        parse_ok, parse_too_short, parse_bad_note, parse_bad_octave
+    };
 
-        if(str.length() < 1 ){
-            throw std::out_of_range("Note(string) : input string ("+str+") is too short");
+    // takes note letter
+    // returns # of semitones from A, or -128 if not a note
+    constexpr int letterOffset(char letter){
+        switch(letter){
+            case 'C': case 'c': return -9;
+            case 'D': case 'd': return -7;
+            case 'E': case 'e': return -5;
+            case 'F': case 'f': return -4;
+            case 'G': case 'g': return -2;
+            case 'A': case 'a': return 0;
+            case 'B': case 'b': return 2;
         }
+        return -128;
+    }
 
-        if(regex_match(toParse.substr(0,1), note_regex)){
-            ret.note = toParse[0];
-            if(toParse.length() == 1){
-                ret.sign = 'n';
-                ret.octave = 4;
-                return ret;
-            }
-            toParse = toParse.substr(1);
-        }
-        else{
-            throw std::out_of_range("Note(string) : input string ("+str+") is invalid (First char is not valid note)");
+    constexpr bool isSign(char c){
+        return c == '#' || c == 'n' || c == 'b';
+    }
+
+    // takes string input, fills ret with {note, sign, octave}
+    // returns parse_ok if valid (no allocation, usable at compile time)
+    constexpr parse_status tryParseString(std::string_view str, parsed_str& ret){
+        if(str.length() < 1) return parse_too_short;
+        if(letterOffset(str[0]) == -128) return parse_bad_note;
+
+        ret.note = str[0];
+        ret.sign = 'n';
+        ret.octave = 4;
+        str.remove_prefix(1);
+        if(str.empty()) return parse_ok;
+
+        if(isSign(str[0])){
+            ret.sign = str[0];
+            str.remove_prefix(1);
+            if(str.empty()) return parse_ok;
         }
 
-        if(regex_match(toParse.substr(0,1), sign_regex)){
-            ret.sign = toParse[0];
-            if(toParse.length() == 1){
-                ret.octave = 4;
-                return ret;
-            }
-            
-            toParse = toParse.substr(1);
+        // octave is "-1" or a single digit
+        if(str.length() == 1 && str[0] >= '0' && str[0] <= '9'){
+            ret.octave = str[0] - '0';
+            return parse_ok;
+        }
+        if(str.length() == 2 && str[0] == '-' && str[1] == '1'){
+            ret.octave = -1;
+            return parse_ok;
         }
+        return parse_bad_octave;
+    }
 
-        if(regex_match(toParse, octave_regex)){
-            if(toParse[0] == '-'){
-                ret.octave = -1*atoi(&toParse[1]);
-                return ret;
-            }
-            else{
-                ret.octave = atoi(&toParse[0]);
+    // takes string input
+    // returns {note, sign, octave} if valid
+    static parsed_str parseString(std::string_view str){
+        parsed_str ret = {};
+        switch(tryParseString(str, ret)){
+            case parse_ok:
                 return ret;
-            }
+            case parse_too_short:
+                throw std::out_of_range("Note(string) : input string ("+std::string(str)+") is too short");
+            case parse_bad_note:
+                throw std::out_of_range("Note(string) : input string ("+std::string(str)+") is invalid (First char is not valid note)");
+            default:
+                throw std::out_of_range("Note(string) : input string ("+std::string(str)+") is invalid EoF");
         }
-
-        throw std::out_of_range("Note(string) : input string ("+str+") is invalid EoF");
     }
 
     // takes parsed string input
     // returns midi index if valid
-    static int parsedToMidi(parsed_str parsed){
-        std::regex note_regex("[a-gA-G]");
-        std::regex sign_regex("[#nb]");
-        
+    constexpr int parsedToMidi(parsed_str parsed){
         // Validate input
-        assert(regex_match(std::to_string(parsed.note), note_regex));
-        assert(regex_match(std::to_string(parsed.sign), sign_regex));
+        assert(letterOffset(parsed.note) != -128);
+        assert(isSign(parsed.sign));
         assert(parsed.octave > -1 && parsed.octave < 9);
         
         int octDist = (parsed.octave-4)*12;
-        int noteDist = 0;
+        int noteDist = letterOffset(parsed.note);
 
-        switch(parsed.note){
-            case 'C': case 'c':
-                noteDist = -9;
-                break;
-            case 'D': case 'd':
-                noteDist = -7;
-                break;
-            case 'E': case 'e':
-                noteDist = -5;
-                break;
-            case 'F': case 'f':
-                noteDist = -4;
-                break;
-            case 'G': case 'g':
-                noteDist = -2;
-                break;
-            case 'A': case 'a':
-                noteDist = 0;
-                break;
-            case 'B': case 'b':
-                noteDist = 2;
-                break;
-        }
         if(parsed.sign == 'b') noteDist -= 1;
         else if(parsed.sign == '#') noteDist += 1;
 
         return octDist + noteDist + 69;
     }
 
+    // 2^(k/12) for k = 0..11
+    constexpr double semitoneRatio[12] = {
+        1.0, 1.0594630943592953, 1.1224620483093730, 1.1892071150027210,
+        1.2599210498948732, 1.3348398541700344, 1.4142135623730951, 1.4983070768766815,
+        1.5874010519681994, 1.6817928305074290, 1.7817974362806785, 1.8877486253633868
+    };
+
+    // takes midi index and frequency of A4
+    // returns equal tempered frequency (no pow, usable at compile time)
+    constexpr double equalTempered(int midi, double root=440.0){
+        int distance = midi - 69;
+        int octave = (distance >= 0) ? distance/12 : -((11-distance)/12);
+        double freq = root * semitoneRatio[distance - octave*12];
+        for(; octave > 0; octave--) freq *= 2;
+        for(; octave < 0; octave++) freq /= 2;
+        return freq;
+    }
+
+    // frequency of every midi index for one root
+    // Midi notes are 0..127, but the table covers every uint8_t value of
+    // Note::index (1 KB instead of 512 bytes): setOctave(9) can leave an
+    // index up to 131, and the AVX2 kernel gathers the raw index byte, so
+    // lookups never need a bounds check or a clamp. Entries past 127
+    // continue the equal tempered scale.
+    struct frequency_table {
+        float root;
+        float hz[256] = {};
+
+        constexpr explicit frequency_table(float root=440.0f) : root(root) {
+            for(int i=0; i<256; i++) hz[i] = (float)equalTempered(i, root);
+        }
+
+        constexpr float operator[](int midi) const { return hz[midi]; }
+    };
+
+    // default A440 tuning, built at compile time
+    constexpr static frequency_table a440 = frequency_table(440.0f);
+
+    // tables each thread keeps for roots other than 440
+    // Building one is 256 equalTempered() calls, so a root switched back
+    // and forth (A440 against A442, a detuned layer) must not rebuild every
+    // call, and four roots at once is more than the demos use. Note_Bench
+    // times lookups while cycling through 1, 2 and 4 roots.
+    const static int frequencyTableSlots = 4;
+
+    // returns table for root, built the first time a thread asks for it
+    // (per thread, so the audio thread never locks or shares a table being
+    // rebuilt; a reference stays valid until frequencyTableSlots other roots
+    // have been asked for on the same thread)
+    static const frequency_table& frequencyTable(float root){
+        if(root == a440.root) return a440;
+        struct table_cache {
+            frequency_table tables[frequencyTableSlots];
+            int used = 0;   // slots holding a table
+            int next = 0;   // slot replaced next, the oldest one
+        };
+        thread_local table_cache cache;
+        for(int i=0; i<cache.used; i++){
+            if(cache.tables[i].root == root) return cache.tables[i];
+        }
+        frequency_table& table = cache.tables[cache.next];
+        table = frequency_table(root);
+        cache.next = (cache.next + 1) % frequencyTableSlots;
+        cache.used = std::min(cache.used + 1, frequencyTableSlots);
+        return table;
+    }
+
     // Takes key ( letter(+sign) )
     // Returns note index as # of semitones from A
-    static int noteIndex(std::string key){
-        char letter = key[0];
-        int noteDist;
-        switch (letter)
-        {
-            case 'C': case 'c':
-                noteDist = -9;
-                break;
-            case 'D': case 'd':
-                noteDist = -7;
-                break;
-            case 'E': case 'e':
-                noteDist = -5;
-                break;
-            case 'F': case 'f':
-                noteDist = -4;
-                break;
-            case 'G': case 'g':
-                noteDist = -2;
-                break;
-            case 'A': case 'a':
-                noteDist = 0;
-                break;
-            case 'B': case 'b':
-                noteDist = 2;
-                break;
-        
-        default:
-            throw std::out_of_range("Note(string) : input letter ("+key+") is not a note");
-            break;
+    static int noteIndex(std::string_view key){
+        int noteDist = letterOffset(key[0]);
+        if(noteDist == -128){
+            throw std::out_of_range("Note(string) : input letter ("+std::string(key)+") is not a note");
         }
         if(key.length() == 1) return noteDist;
         else if(key.length() == 2){
@@ -148,12 +186,12 @@ namespace helper{
 
             return noteDist;
         }
-        throw std::out_of_range("Note(string) : input letter ("+key+") is not a note");
+        throw std::out_of_range("Note(string) : input letter ("+std::string(key)+") is not a note");
     }
 
     // takes string input
     // returns Midi index if valid
-    static int stringToMidi(std::string str){
+    static int stringToMidi(std::string_view str){
         parsed_str parsed = parseString(str);
         return parsedToMidi(parsed);
     }
@@ -251,14 +289,52 @@ namespace helper{
         return ret;
     }
 
+    // fixed-capacity note name (letter + optional sign), no heap allocation
+    struct note_name {
+        char str[2] = {};
+        int length = 0;
+
+        constexpr void push_back(char c){ str[length++] = c; }
+        constexpr std::string_view view() const { return std::string_view(str, length); }
+    };
+
+    // fixed-capacity chord interval list, no heap allocation
+    struct interval_set {
+        const static int capacity = chord_type::maxLength+1; // longest chord + one add
+        int data[capacity] = {};
+        int count = 0;
+
+        constexpr void push_back(int interval){
+            assert(count < capacity);
+            data[count++] = interval;
+        }
+        constexpr int size() const { return count; }
+        constexpr int& operator[](int i){ return data[i]; }
+        constexpr const int& operator[](int i) const { return data[i]; }
+        constexpr int* begin(){ return data; }
+        constexpr int* end(){ return data+count; }
+        constexpr const int* begin() const { return data; }
+        constexpr const int* end() const { return data+count; }
+
+        // insertion sort, fine for <= 8 intervals
+        constexpr void sort(){
+            for(int i=1; i<count; i++){
+                int val = data[i];
+                int j = i;
+                for(; j>0 && data[j-1] > val; j--) data[j] = data[j-1];
+                data[j] = val;
+            }
+        }
+    };
+
     struct parsed_chord {
-        std::string key, sign, bass;
-        std::vector<int> intervals; 
-        chord_type::quality quality;
+        note_name key, bass;
+        interval_set intervals; 
+        chord_type::quality quality = chord_type::M;
     };
 
     
-    parsed_chord buildChord(parsed_chord chord, int length){
+    constexpr parsed_chord buildChord(parsed_chord chord, int length){
         for(int i=0; i<length; i++){
             int interval = chord_type::table[chord.quality][i];
             if(interval >= 0) chord.intervals.push_back(interval);
@@ -266,164 +342,374 @@ namespace helper{
         return chord;
     }
 
-    static parsed_chord parseChord(std::string name){
-        std::string str = name;
-        
-        // Key matching
-        std::regex key("^[a-gA-G]");
-        std::regex sign("^[bn#]");
-        
-        // Quality matching
-        std::regex major("^((maj)|(M))");
-        std::regex minor("^((min)|(m)|(-))");
-        std::regex dim("^((dim)|o)");
-        std::regex aug("^((aug)|(\\+)|(\\+5))");
-        
-        // Extensions, Alterations, Figured bass
-        std::regex extended("^(7|9|(11)|(13))");
-        std::regex alter("^([#b][59])");
-        std::regex add("^(add[24689])");
-        std::regex drop("^(add[24689])");
-        std::regex bass("^(\\/[a-gA-g][b#]?)");
-
-        std::smatch m;
+    // returns pitch class [0, 11] of any interval
+    constexpr int pitchClass(int semitones){
+        return ((semitones % 12) + 12) % 12;
+    }
+
+    /*
+        pitch_set: 12-bit pitch class set, bit k = k semitones above the root
+
+            set.contains(semitones)          O(1) membership
+            set.transpose(semitones)         rotate
+            set.isSubsetOf(other), set.isSupersetOf(other)
+            set.size()                       popcount
+    */
+    struct pitch_set {
+        uint16_t bits = 0;
+
+        constexpr pitch_set(){}
+        constexpr explicit pitch_set(uint16_t bits) : bits(bits & 0xFFF) {}
+
+        // builds set from a -1 padded table row (scale_type::table, chord_type::table)
+        static constexpr pitch_set fromTable(const int* row, int length){
+            pitch_set ret;
+            for(int i=0; i<length; i++){
+                if(row[i] >= 0) ret = ret.with(row[i]);
+            }
+            return ret;
+        }
+
+        static constexpr pitch_set fromIntervals(const interval_set& intervals){
+            pitch_set ret;
+            for(int interval:intervals) ret = ret.with(interval);
+            return ret;
+        }
+
+        constexpr pitch_set with(int semitones) const {
+            return pitch_set(bits | (1 << pitchClass(semitones)));
+        }
+
+        constexpr bool contains(int semitones) const {
+            return (bits >> pitchClass(semitones)) & 1;
+        }
+
+        constexpr pitch_set transpose(int semitones) const {
+            int shift = pitchClass(semitones);
+            return pitch_set((bits << shift) | (bits >> (12 - shift)));
+        }
+
+        constexpr bool isSubsetOf(pitch_set other) const { return (bits & ~other.bits) == 0; }
+        constexpr bool isSupersetOf(pitch_set other) const { return other.isSubsetOf(*this); }
+
+        constexpr int size() const {
+            int count = 0;
+            for(uint16_t b = bits; b; b &= b-1) count++;
+            return count;
+        }
+
+        constexpr pitch_set operator|(pitch_set other) const { return pitch_set(bits | other.bits); }
+        constexpr pitch_set operator&(pitch_set other) const { return pitch_set(bits & other.bits); }
+        constexpr bool operator==(pitch_set other) const { return bits == other.bits; }
+        constexpr bool operator!=(pitch_set other) const { return bits != other.bits; }
+    };
+
+    template <int N>
+    struct pitch_set_table {
+        pitch_set sets[N] = {};
+        constexpr const pitch_set& operator[](int i) const { return sets[i]; }
+    };
+
+    constexpr pitch_set_table<scale_type::numScales> makeScaleSets(){
+        pitch_set_table<scale_type::numScales> ret;
+        for(int i=0; i<scale_type::numScales; i++){
+            ret.sets[i] = pitch_set::fromTable(scale_type::table[i], scale_type::maxLength);
+        }
+        return ret;
+    }
+
+    // chordSets[quality][length] = first length tones of chord_type::table[quality]
+    constexpr pitch_set_table<chord_type::maxLength+1> makeChordSets(int quality){
+        pitch_set_table<chord_type::maxLength+1> ret;
+        for(int length=1; length<=chord_type::maxLength; length++){
+            ret.sets[length] = pitch_set::fromTable(chord_type::table[quality], length);
+        }
+        return ret;
+    }
+
+    // pitch class sets of every scale, relative to the tonic
+    constexpr static pitch_set_table<scale_type::numScales> scaleSets = makeScaleSets();
+
+    // pitch class sets of every chord quality by length (3 = triad, 4 = 7th, ...)
+    constexpr static pitch_set_table<chord_type::maxLength+1> chordSets[chord_type::num] = {
+        makeChordSets(chord_type::M), makeChordSets(chord_type::m), makeChordSets(chord_type::aug),
+        makeChordSets(chord_type::dim), makeChordSets(chord_type::dom),
+        makeChordSets(chord_type::sus2), makeChordSets(chord_type::sus4),
+    };
+
+    // removes token from front of str if present
+    // returns true if removed
+    constexpr bool consume(std::string_view& str, std::string_view token){
+        if(str.substr(0, token.length()) != token) return false;
+        str.remove_prefix(token.length());
+        return true;
+    }
+
+    // Parses chord symbol, e.g. "Dbm7b5", "Cmaj9", "F/C"
+    //  [key][quality][extension][alteration][add][bass]
+    // constexpr so literals can be compiled ahead of time:
+    //  constexpr helper::parsed_chord c = helper::parseChord("m7b5");
+    constexpr parsed_chord parseChord(std::string_view name){
+        std::string_view str = name;
         parsed_chord chord;
-        int length = 0;
+        int length = 3;
 
         // First, pop off key and sign
-        if(std::regex_search(str, m, key)){
-            chord.key = m.str();
-            str = m.suffix().str();
+        if(!str.empty() && letterOffset(str[0]) != -128){
+            chord.key.push_back(str[0]);
+            str.remove_prefix(1);
         }
-        if(std::regex_search(str, m, sign)){
-            chord.key += m.str();
-            str = m.suffix().str();
+        if(!str.empty() && isSign(str[0])){
+            chord.key.push_back(str[0]);
+            str.remove_prefix(1);
         }
 
-        std::cout << "Chord = " << chord.key << chord.sign << " ";
-
         // Then determine quality
-        if(std::regex_search(str, m, major) || str.length()==0){
+        if(consume(str, "maj") || consume(str, "M") || str.empty()){
             chord.quality = chord_type::M;
-            std::cout << "Major ";
-            str = m.suffix().str();
         }
-        else if(std::regex_search(str, m, minor)){
+        else if(consume(str, "min") || consume(str, "m") || consume(str, "-")){
             chord.quality = chord_type::m;
-            std::cout << "Minor ";
-            str = m.suffix().str();
         }
-        else if(std::regex_search(str, m, aug)){
+        else if(consume(str, "aug") || consume(str, "+")){
             chord.quality = chord_type::aug;
-            std::cout << "Aug ";
-            str = m.suffix().str();
         }
-        else if(std::regex_search(str, m, dim)){
+        else if(consume(str, "dim") || consume(str, "o")){
             chord.quality = chord_type::dim;
-            std::cout << "Dim ";
-            str = m.suffix().str();
         }
-        else if(str.substr(0,4) == "sus2"){
+        // sus2/sus4 are recognised but not consumed, so they are left over
+        // and rejected below, as the regex parser did
+        else if(str.substr(0, 4) == "sus2"){
             chord.quality = chord_type::sus2;
         }
-        else if(str.substr(0,4) == "sus4"){
+        else if(str.substr(0, 4) == "sus4"){
             chord.quality = chord_type::sus4;
         }
         else{
             chord.quality = chord_type::dom;
         }
 
-        
         // then check for extensions
-        if(std::regex_search(str, m, extended)){
-            int extend = std::stoi(m[0]);
-            std::cout << "ext=" << m.str() << " ";
-            if(extend == 7) length = 4;
-            if(extend == 9) length = 5;
-            if(extend == 11) length = 6;
-            if(extend == 13) length = 7;
-            str = m.suffix().str();
-        }
-        else{
-            length = 3;
-        }
+        if(consume(str, "7")) length = 4;
+        else if(consume(str, "9")) length = 5;
+        else if(consume(str, "11")) length = 6;
+        else if(consume(str, "13")) length = 7;
 
         // Build the base chord
         chord = buildChord(chord, length);
         
-        // Now look for alterations
-        if(std::regex_search(str, m, alter)){
-            if (m.str()[0] == 'b'){
-                if(m.str()[1] == '5') {
-                    chord.intervals[chord_type::fifth] -= 1;
-                    std::cout << "flat 5 ";
-                }
-                if(m.str()[1] == '9') {
-                    if(chord.intervals.size() == 3 || chord.intervals.size() == 4){
-                        chord.intervals.push_back(chord_type::table[chord.quality][chord_type::ninth]);
-                    }
-                    chord.intervals[chord.intervals.size()-1] -= 1;
-                    std::cout << "flat 9 ";
-                }
+        // Now look for alterations (b5, #5, b9, #9)
+        if(str.length() >= 2 && (str[0] == 'b' || str[0] == '#') && (str[1] == '5' || str[1] == '9')){
+            int shift = (str[0] == 'b') ? -1 : 1;
+            if(str[1] == '5'){
+                chord.intervals[chord_type::fifth] += shift;
             }
-            else if (m.str()[0] == '#'){
-                if(m.str()[1] == '5') {
-                    chord.intervals[chord_type::fifth] += 1;
-                    std::cout << "sharp 5 ";
-                    }
-                if(m.str()[1] == '9') {
-                    if(chord.intervals.size() == 3 || chord.intervals.size() == 4){
-                        chord.intervals.push_back(chord_type::table[chord.quality][chord_type::ninth]);
-                    }
-                    chord.intervals[chord.intervals.size()-1] += 1;
-                    std::cout << "sharp 9 ";
+            else{
+                if(chord.intervals.size() == 3 || chord.intervals.size() == 4){
+                    chord.intervals.push_back(chord_type::table[chord.quality][chord_type::ninth]);
                 }
+                chord.intervals[chord.intervals.size()-1] += shift;
             }
-
-            str = m.suffix().str();
+            str.remove_prefix(2);
         }
         
-        if(std::regex_search(str, m, add)){
-            int add = std::stoi(m.str().substr(3,4));
-            std::cout << "add " << add;
-            int interval;
-            switch(add){
-                case 2:
+        // add2, add4, add6, add8, add9
+        if(str.length() >= 4 && str.substr(0, 3) == "add"){
+            int interval = 0;
+            bool valid = true;
+            switch(str[3]){
+                case '2':
                     interval = chord_type::table[chord.quality][chord_type::ninth] - 12;
                     break;
-                case 4:
+                case '4':
                     interval = chord_type::table[chord.quality][chord_type::eleventh] - 12;
                     break;
-                case 6:
+                case '6':
                     interval = chord_type::table[chord.quality][chord_type::thirteenth] - 12;
                     break;
-                case 8:
+                case '8':
                     interval = 12;
                     break;
-                case 9:
+                case '9':
                     interval = chord_type::table[chord.quality][chord_type::ninth];
                     break;
+                default:
+                    valid = false;
+            }
+            if(valid){
+                chord.intervals.push_back(interval);
+                chord.intervals.sort();
+                str.remove_prefix(4);
             }
-            chord.intervals.push_back(interval);
-            std::sort (chord.intervals.begin(), chord.intervals.end());
-            str = m.suffix().str();
         }
 
-         if(std::regex_search(str, m, bass)){
-             chord.bass = m.str().substr(1);
-             str = m.suffix().str();
-         }
-         else{
-             chord.bass = chord.key;
-         }
+        // Figured bass, e.g. "/C" or "/Eb", any letter of [a-gA-g] like the
+        // regex parser (theory::chord() rejects one that isn't a note)
+        if(str.length() >= 2 && str[0] == '/' && str[1] >= 'A' && str[1] <= 'g'){
+            chord.bass.push_back(str[1]);
+            str.remove_prefix(2);
+            if(!str.empty() && (str[0] == 'b' || str[0] == '#')){
+                chord.bass.push_back(str[0]);
+                str.remove_prefix(1);
+            }
+        }
+        else{
+            chord.bass = chord.key;
+        }
 
         if(str.length() != 0){
-            throw std::out_of_range("Chord(string) : Chord ("+name+") is invalid, "+str+" was left over");
+            throw std::out_of_range("Chord(string) : Chord ("+std::string(name)+") is invalid, "+std::string(str)+" was left over");
         }
 
         return chord;
     }
 
+    // parsed chord symbol plus its figured bass, ready to transpose
+    struct chord_pattern {
+        parsed_chord parsed;
+        pitch_set pitches;      // chord tones relative to the root
+        int rootClass = -1;     // pitch class of key (0 = C), -1 if no valid key
+        bool hasBass = false;   // figured bass differs from key
+        int bassClass = 0;      // pitch class of figured bass (0 = C)
+        int inversion = 0;      // inversion for a root of rootClass, -1 if bass not in chord
+    };
+
+    // returns index of the last chord tone on the figured bass, -1 if none
+    static int bassInversion(const chord_pattern& pattern, int rootIdx){
+        int bassIdx = -1;
+        for(int i=0; i<pattern.parsed.intervals.size(); i++){
+            int noteClass = ((rootIdx + pattern.parsed.intervals[i]) % 12 + 12) % 12;
+            if(noteClass == pattern.bassClass) bassIdx = i;
+        }
+        return bassIdx;
+    }
+
+    static chord_pattern compileChord(std::string_view name){
+        chord_pattern pattern;
+        pattern.parsed = parseChord(name);
+        pattern.pitches = pitch_set::fromIntervals(pattern.parsed.intervals);
+        parsed_str key = {};
+        if(tryParseString(pattern.parsed.key.view(), key) == parse_ok){
+            pattern.rootClass = parsedToMidi(key) % 12;
+        }
+        if(pattern.parsed.bass.view() != pattern.parsed.key.view()){
+            pattern.hasBass = true;
+            // noteIndex is relative to A; Cb/B# never match a chord tone's key()
+            pattern.bassClass = noteIndex(pattern.parsed.bass.view()) + 9;
+            pattern.inversion = bassInversion(pattern, pattern.rootClass);
+        }
+        return pattern;
+    }
+
+    /*
+        chord_cache: bounded, thread-safe table of compiled chord symbols
+
+        Slots are fixed at construction, so lookups and hits never allocate.
+        Symbols longer than maxSymbol bypass the cache.
+        Use hits()/misses()/evictions() to size it.
+    */
+    class chord_cache {
+        public:
+            const static int maxSymbol = 16;
+            const static int probeLength = 4;
+
+            chord_cache(int capacity=64){ resize(capacity); }
+
+            // returns compiled pattern for symbol (parsing on first use)
+            chord_pattern get(std::string_view name){
+                if(name.length() > maxSymbol){
+                    mMisses++;
+                    return compileChord(name);
+                }
+
+                // slot count can change between the locks, take the modulo inside each
+                size_t h = hash(name);
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    size_t home = h % mSlots.size();
+                    for(int i=0; i<probeLength; i++){
+                        slot& s = mSlots[(home+i) % mSlots.size()];
+                        if(!s.used) break;
+                        if(s.symbol() == name){
+                            mHits++;
+                            return s.pattern;
+                        }
+                    }
+                }
+
+                // parse outside the lock, errors are not cached
+                mMisses++;
+                chord_pattern pattern = compileChord(name);
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                size_t home = h % mSlots.size();
+                slot* target = &mSlots[home];
+                for(int i=0; i<probeLength; i++){
+                    slot& s = mSlots[(home+i) % mSlots.size()];
+                    if(!s.used || s.symbol() == name){
+                        target = &s;
+                        break;
+                    }
+                }
+                if(target->used && target->symbol() != name) mEvictions++;
+                if(!target->used) mSize++;
+                target->used = true;
+                target->length = name.copy(target->chars, maxSymbol);
+                target->pattern = pattern;
+                return pattern;
+            }
+
+            // drops all entries and counters, sets number of slots
+            void resize(int capacity){
+                std::lock_guard<std::mutex> lock(mMutex);
+                mSlots.assign(capacity > 0 ? capacity : 1, slot());
+                mSize = 0;
+                mHits = 0;
+                mMisses = 0;
+                mEvictions = 0;
+            }
+
+            int capacity(){ 
+                std::lock_guard<std::mutex> lock(mMutex);
+                return mSlots.size(); 
+            }
+            int size(){ return mSize; }
+            uint64_t hits(){ return mHits; }
+            uint64_t misses(){ return mMisses; }
+            uint64_t evictions(){ return mEvictions; }
+
+        private:
+            struct slot {
+                bool used = false;
+                char chars[maxSymbol] = {};
+                size_t length = 0;
+                chord_pattern pattern;
+
+                std::string_view symbol() const { return std::string_view(chars, length); }
+            };
+
+            // FNV-1a
+            static size_t hash(std::string_view str){
+                uint32_t h = 2166136261u;
+                for(char c:str){
+                    h ^= (unsigned char)c;
+                    h *= 16777619u;
+                }
+                return h;
+            }
+
+            std::mutex mMutex;
+            std::vector<slot> mSlots;
+            std::atomic<int> mSize{0};
+            std::atomic<uint64_t> mHits{0}, mMisses{0}, mEvictions{0};
+    };
+
+    // shared cache used by theory::chord()
+    inline chord_cache& chordCache(){
+        static chord_cache cache;
+        return cache;
+    }
+
     
 }
 
@@ -0,0 +1,248 @@
+#pragma once
+
+// The audio side of Note_Demo_02: notes queued by the UI thread, started
+// on the audio thread at their exact frame on pool voices, in a header so
+// headless checks can play the demo's songs without the app
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+#include "al/io/al_AudioIOData.hpp"
+
+#include "../audio_engine/parallel.h"
+#include "../audio_engine/queue.h"
+#include "../audio_engine/timeline.h"
+#include "../audio_engine/voices.h"
+
+#include "note.h"
+#include "notebatch.h"
+#include "squarewave.h"
+#include "tempo.h"
+
+// A note queued by the UI thread for the audio thread
+struct note_event
+{
+  int64_t frame;  // start, in frames on the audio clock
+  int64_t length; // frames until note off
+  float freq;
+  float amp;
+};
+
+class NotePlayer
+{
+public:
+  // Notes are handed to the audio thread through a wait-free queue and
+  // started there at their exact frame, so key presses never touch the
+  // synth or the sequencer while it renders.
+  engine::FrameClock clock;
+  engine::SpscQueue<note_event, 256> noteQueue;
+  engine::Timeline<note_event, 256> noteStarts;
+  engine::Timeline<engine::note_ref, 256> noteOffs;
+  engine::VoicePool<SquareWave> voices;
+  int nextNoteId = 1 << 20; // clear of the keyboard's midi note ids
+  int64_t songStart = 0;    // frame tick 0 of the tempo map plays at
+
+  // Voices render on this many threads, 1 is the pool's own render() on the
+  // audio thread alone
+  engine::ParallelRender renderer;
+
+  double sampleRate = 48000;
+  int framesPerBuffer = 512;
+
+  // Before audio starts, with gam::sampleRate() already set
+  void init(double sampleRate, int framesPerBuffer, int renderThreads = 1)
+  {
+    this->sampleRate = sampleRate;
+    this->framesPerBuffer = framesPerBuffer;
+
+    // Happy birthday holds up to 4 chord notes over a melody note
+    voices.allocate(16, engine::steal_oldest);
+    // a stolen note ramps to silence over its last block
+    voices.fade([](SquareWave &voice) { voice.mAmp.parameter().set(0); });
+    renderer.prepare(64, std::max<int>(std::thread::hardware_concurrency(), 1), framesPerBuffer);
+    renderer.threads(renderThreads);
+  }
+
+  // Audio thread, at block start: drains the queue, then starts and stops
+  // what's due in the block
+  void events(int frames)
+  {
+    int64_t blockStart = clock.now();
+    int64_t blockEnd = blockStart + frames;
+
+    note_event note;
+    while (noteQueue.pop(note))
+      noteStarts.add(note.frame, note);
+    noteStarts.take(blockEnd, [&](const note_event &n, int64_t frame) {
+      startNote(n, (int)std::max<int64_t>(frame - blockStart, 0));
+    });
+    noteOffs.take(blockEnd, [&](const engine::note_ref &n, int64_t frame) {
+      engine::releaseNote(n, (int)std::max<int64_t>(frame - blockStart, 0));
+    });
+  }
+
+  // Audio thread, after events(): renders every voice into io and moves the
+  // clock on a block
+  void render(al::AudioIOData &io)
+  {
+    // notes play on pool voices, the synth and its sequencer would lock every block
+    if (renderer.threads() > 1)
+    {
+      renderer.render(voices.voices(), io);
+      voices.update();
+    }
+    else
+      voices.render(io);
+    clock.advance(io.framesPerBuffer());
+  }
+
+  // Starts a queued note offset frames into the block (audio thread)
+  void startNote(const note_event &note, int offset)
+  {
+    SquareWave *voice = voices.acquire(note.freq);
+    if (!voice)
+      return;
+    voice->mAmp.parameter().set(note.amp);
+    voice->mFreq->set(note.freq);
+    voice->mAttack->set(0.1);
+    voice->mRelease->set(0.1);
+    voice->mPanPos->set(0.0);
+
+    int id = voices.triggerOn(voice, offset, nextNoteId++);
+    noteOffs.add(note.frame + note.length, {voice, id});
+  }
+
+  // Song keys of the demo, returns false if key plays nothing here
+  bool playKey(int key)
+  {
+    switch (key)
+    {
+    case 'a':
+      playHappyBirthday(theory::Note("C4"), 90);
+      return true;
+    case 's':
+      playHappyBirthday(theory::Note("G3"), 120);
+      return true;
+    }
+    return false;
+  }
+
+  // Returns the first frame a note queued now can still start on time
+  int64_t nextFrame() { return clock.now() + framesPerBuffer; }
+
+  // New code: a function to play a note A
+  // frame is on the audio clock (see nextFrame()), the note sounds for 90% of length
+  int64_t playNote(int64_t frame, theory::Note note, int64_t length, float amp = 0.2)
+  {
+    return playFrequency(frame, note.frequency(), length, amp);
+  }
+
+  int64_t playFrequency(int64_t frame, float frequency, int64_t length, float amp)
+  {
+    noteQueue.push({frame, (int64_t)(length * 0.9), frequency, amp});
+    return frame + length;
+  }
+
+  int64_t playChord(int64_t frame, theory::notelist chord, int64_t length, bool roll = false)
+  {
+    // every note's frequency in one batch
+    float frequencies[theory::notelist::capacity()];
+    theory::frequencies(chord, frequencies);
+
+    int64_t localFrame = 0;
+    for (int i = 0; i < chord.size(); i++)
+    {
+      playFrequency(frame + localFrame, frequencies[i], length, 0.05);
+      if (roll)
+        localFrame += length / 32;
+    }
+    return frame + length;
+  }
+
+  // Same as above, but positioned in ticks on a tempo map starting at songStart
+  int64_t playNote(const TempoMap &tempo, int64_t tick, theory::Note note, int64_t length)
+  {
+    int64_t start = songStart + tempo.tickToFrame(tick);
+    playNote(start, note, songStart + tempo.tickToFrame(tick + length) - start);
+    return tick + length;
+  }
+
+  int64_t playChord(const TempoMap &tempo, int64_t tick, theory::notelist chord, int64_t length, bool roll=false)
+  {
+    int64_t start = songStart + tempo.tickToFrame(tick);
+    playChord(start, chord, songStart + tempo.tickToFrame(tick + length) - start, roll);
+    return tick + length;
+  }
+
+  void playHappyBirthday(theory::Note root, float bpm)
+  {
+    using namespace theory;
+
+    // Happy birthday uses: P1(C), M2(D), M3(E), P4(F), P5(G), M6(A), and m7(Bb)
+    notelist majScale = scale(root, scaleT::Major);
+    Note M2 = scale_degree(majScale, degree::II);
+    Note M3 = scale_degree(majScale, degree::III);
+    Note P4 = scale_degree(majScale, degree::IV);
+    Note P5 = scale_degree(majScale, degree::V);
+    Note M6 = scale_degree(majScale, degree::VI);
+    Note m7 = root.interval(intervalT::m7);
+    Note P8 = scale_degree(majScale, degree::VIII);
+
+    // For chords it needs: F Maj, C Dom7, Bb Maj, F/C (2nd inversion)
+    // (Also dropping the root of the chord down an octave or Perfect Eighth)
+    notelist chord1 = chord(P4.interval(12), "maj");
+    notelist chord2 = root.chord("7");
+    notelist chord3 = chord(m7.interval(-12), "maj");
+    notelist chord4 = chord("F/C"); // 2nd inversion
+
+    // Now lets set up a tempo
+    //  syntax: TempoMap(sampleRate, bpm, timeSig top, timeSig bottom)
+    // positions are integer ticks, so timing doesn't drift as notes add up
+    int64_t tick = 0;
+    TempoMap tempo(sampleRate, bpm, 3, 4);
+    songStart = nextFrame(); // every note is timed from the same frame
+    // this allows us to say get exact durations for common note types
+
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::eighth, true)); // true = dotted note
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::sixteenth));
+
+    playChord(tempo, tick, chord1, tempo.duration(Tempo::half));
+    tick = playNote(tempo, tick, M2, tempo.duration(Tempo::quarter));
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::quarter));
+    tick = playNote(tempo, tick, P4, tempo.duration(Tempo::quarter));
+
+    playChord(tempo, tick, chord2, tempo.duration(Tempo::half));
+    tick = playNote(tempo, tick, M3, tempo.duration(Tempo::half));
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::eighth, true)); // true = dotted note
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::sixteenth));
+
+    tick = playNote(tempo, tick, M2, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, P5, tempo.duration(Tempo::q));
+
+    playChord(tempo, tick, chord1, tempo.duration(Tempo::h));
+    tick = playNote(tempo, tick, P4, tempo.duration(Tempo::h));
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::e, true));
+    tick = playNote(tempo, tick, root, tempo.duration(Tempo::s));
+
+    tick = playNote(tempo, tick, P8, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, M6, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, P4, tempo.duration(Tempo::q));
+
+    playChord(tempo, tick, chord3, tempo.duration(Tempo::h));
+    tick = playNote(tempo, tick, M3, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, M2, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, m7, tempo.duration(Tempo::e, true));
+    tick = playNote(tempo, tick, m7, tempo.duration(Tempo::s));
+
+    playChord(tempo, tick, chord4, tempo.duration(Tempo::h));
+    tick = playNote(tempo, tick, M6, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, P4, tempo.duration(Tempo::q));
+    playChord(tempo, tick, chord2, tempo.duration(Tempo::q));
+    tick = playNote(tempo, tick, P5, tempo.duration(Tempo::q));
+
+    playChord(tempo, tick, chord1, tempo.duration(Tempo::h));
+    tick = playNote(tempo, tick, P4, tempo.duration(Tempo::h));
+  }
+};
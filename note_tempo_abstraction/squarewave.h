@@ -0,0 +1,112 @@
+#pragma once
+
+// SquareWave voice of Note_Demo_02, in a header so the benchmarks can run
+// it without the app
+
+#include "Gamma/Effects.h"
+#include "Gamma/Envelope.h"
+
+#include "al/scene/al_PolySynth.hpp"
+#include "al/ui/al_Parameter.hpp"
+
+#include "../audio_engine/block.h"
+#include "../audio_engine/params.h"
+#include "../audio_engine/wavetable.h"
+
+// Odd harmonics at 1/n up to the 7th (f, 3f, 5f, 7f), built once and
+// shared by every SquareWave voice
+inline const engine::Wavetable &squareTable()
+{
+  static const engine::Wavetable table(7, [](int n) { return n % 2 ? 1.0 / n : 0.0; });
+  return table;
+}
+
+class SquareWave : public al::SynthVoice
+{
+public:
+  // Unit generators
+  gam::Pan<> mPan;
+  engine::TableOsc mOsc; // all four partials in one table read
+
+  gam::Env<3> mAmpEnv;
+  bool mReleasing = false; // note off waiting for its frame
+
+  // Parameter handles, resolved once in init()
+  engine::SmoothedParameter mAmp;
+  al::Parameter *mFreq;
+  al::Parameter *mAttack;
+  al::Parameter *mRelease;
+  al::Parameter *mPanPos;
+
+  // Initialize voice. This function will only be called once per voice when
+  // it is created. Voices will be reused if they are idle.
+  void init() override
+  {
+    // Intialize envelope
+    mAmpEnv.curve(0); // make segments lines
+    mAmpEnv.levels(0, 1, 1, 0);
+    mAmpEnv.sustainPoint(2); // Make point 2 sustain until a release is issued
+
+    mOsc.table(squareTable());
+
+    mAmp.bind(createInternalTriggerParameter("amplitude", 0.8, 0.0, 1.0));
+    mFreq = &createInternalTriggerParameter("frequency", 440, 20, 5000);
+    mAttack = &createInternalTriggerParameter("attackTime", 0.1, 0.01, 3.0);
+    mRelease = &createInternalTriggerParameter("releaseTime", 0.1, 0.1, 10.0);
+    mPanPos = &createInternalTriggerParameter("pan", 0.0, -1.0, 1.0);
+  }
+
+  // The audio processing function
+  void onProcess(al::AudioIOData &io) override
+  {
+    // Get the values from the parameters and apply them to the corresponding
+    // unit generators. You could place these lines in the onTrigger() function,
+    // but placing them here allows for realtime prototyping on a running
+    // voice, rather than having to trigger a new voice to hear the changes.
+    // Parameters will update values once per audio callback because they
+    // are outside the sample processing loop. The handles were looked up
+    // once in init(), so no string lookups happen here.
+    // The table level is picked here, high notes drop the partials
+    // that would land above Nyquist
+    mOsc.freq(mFreq->get(), io.framesPerSecond());
+
+    mAmpEnv.lengths()[0] = mAttack->get();
+    mAmpEnv.lengths()[2] = mRelease->get();
+    mPan.pos(mPanPos->get());
+
+    float gainL, gainR;
+    engine::panGains(mPan, gainL, gainR);
+
+    // Amplitude is ramped across the block so changes don't click
+    mAmp.beginBlock(io.framesPerBuffer());
+    // the release starts on the note off's exact frame
+    int releaseFrame = mReleasing ? getEndOffsetFrames(io.framesPerBuffer()) : -1;
+    auto release = [&] { mAmpEnv.release(); mReleasing = false; };
+    engine::processBlock(io, releaseFrame, release, [&](const engine::block_span &b) {
+      float osc[engine::blockChunk], env[engine::blockChunk];
+      mOsc.fill(osc, b.frames);
+      for (int i = 0; i < b.frames; i++) env[i] = mAmpEnv() * mAmp.next();
+
+      for (int i = 0; i < b.frames; i++) osc[i] *= env[i];
+      engine::mixPanned(b, osc, gainL, gainR);
+    });
+    // We need to let the synth know that this voice is done
+    // by calling the free(). This takes the voice out of the
+    // rendering chain
+    if (mAmpEnv.done())
+      free();
+  }
+
+  // The triggering functions just need to tell the envelope to start or release
+  // The audio processing function checks when the envelope is done to remove
+  // the voice from the processing chain.
+  void onTriggerOn() override
+  {
+    mAmpEnv.reset();
+    mAmp.snap();
+    mOsc.reset();
+    mReleasing = false;
+  }
+  // released in onProcess() on the note off's frame
+  void onTriggerOff() override { mReleasing = true; }
+};
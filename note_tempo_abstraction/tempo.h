@@ -1,9 +1,14 @@
+#pragma once
+
 #include <string>
 #include <vector>
 #include <stdio.h>
 #include <ostream>
 #include <assert.h>  
 #include <regex>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 const static int numNotes = 6;
 const static float note_length[numNotes] = {4, 2, 1, 0.5, 0.25, 0.125};
@@ -48,4 +53,170 @@ class Tempo{
             if(dot) duration *= 1.5;
             return duration;
         }
-};
\ No newline at end of file
+};
+
+/*
+    TempoMap: tempo and time signature changes in integer ticks
+
+        Positions are stored in ticks (ppq per quarter note) so nothing
+        drifts over long pieces. Each tempo change keeps the sample frame it
+        starts on (a prefix sum), so tickToFrame is a binary search and
+        playbackFrame is O(1) while ticks only move forward.
+
+        TempoMap map(48000, 120);        // sampleRate, bpm, sigTop, sigBottom, ppq
+        map.setTempo(map.barToTick(8), 140);
+        map.setTimeSignature(16, 3, 4);  // from bar 16 on
+        int64_t t = map.barToTick(2) + map.duration(Tempo::eighth);
+        int64_t frame = map.tickToFrame(t);
+*/
+class TempoMap{
+    public:
+        const static int defaultPPQ = 960;
+
+        struct tempoChange{
+            int64_t tick;
+            float bpm;
+            double frame;  // frame at tick (unrounded, so rounding never accumulates)
+        };
+
+        struct signatureChange{
+            int64_t bar;
+            int64_t tick;
+            Tempo::timeSignature timeSig;
+        };
+
+        explicit TempoMap(double sampleRate=48000, float bpm=120, int sigTop=4, int sigBottom=4, int ppq=defaultPPQ){
+            assert(sampleRate > 0);
+            assert(ppq > 0);
+
+            this->sampleRate = sampleRate;
+            this->ppq = ppq;
+            setTempo(0, bpm);
+            setTimeSignature(0, sigTop, sigBottom);
+        }
+
+        // sets tempo from tick onward (replaces a change at the same tick)
+        void setTempo(int64_t tick, float bpm){
+            assert(bpm > 0);
+            assert(tick >= 0);
+
+            auto it = std::lower_bound(tempos.begin(), tempos.end(), tick,
+                [](const tempoChange& c, int64_t t){ return c.tick < t; });
+            if(it != tempos.end() && it->tick == tick) it->bpm = bpm;
+            else it = tempos.insert(it, {tick, bpm, 0});
+
+            // update prefix frames from the change onward
+            for(size_t i = it - tempos.begin(); i < tempos.size(); i++){
+                if(i == 0) tempos[i].frame = 0;
+                else{
+                    const tempoChange& prev = tempos[i-1];
+                    tempos[i].frame = prev.frame + (tempos[i].tick - prev.tick) * framesPerTick(prev.bpm);
+                }
+            }
+            cursor = 0;
+        }
+
+        // sets time signature from bar onward (replaces a change at the same bar)
+        void setTimeSignature(int64_t bar, int sigTop, int sigBottom){
+            assert(sigBottom%4 == 0);
+            assert(bar >= 0);
+
+            auto it = std::lower_bound(signatures.begin(), signatures.end(), bar,
+                [](const signatureChange& c, int64_t b){ return c.bar < b; });
+            if(it != signatures.end() && it->bar == bar) it->timeSig = {sigTop, sigBottom};
+            else it = signatures.insert(it, {bar, 0, {sigTop, sigBottom}});
+
+            for(size_t i = it - signatures.begin(); i < signatures.size(); i++){
+                if(i == 0) signatures[i].tick = 0;
+                else{
+                    const signatureChange& prev = signatures[i-1];
+                    signatures[i].tick = prev.tick + (signatures[i].bar - prev.bar) * barTicks(prev.timeSig);
+                }
+            }
+        }
+
+        // returns sample frame of tick, O(log n)
+        int64_t tickToFrame(int64_t tick) const {
+            return frameIn(tempoIndex(tick), tick);
+        }
+
+        // returns sample frame of tick, O(1) when tick moves forward
+        // (keeps a cursor, so use one map per playback thread)
+        int64_t playbackFrame(int64_t tick){
+            if(tick < tempos[cursor].tick) cursor = tempoIndex(tick);
+            while(cursor+1 < tempos.size() && tempos[cursor+1].tick <= tick) cursor++;
+            return frameIn(cursor, tick);
+        }
+
+        // returns time of tick in seconds
+        double tickToSeconds(int64_t tick) const {
+            return tickToFrame(tick) / sampleRate;
+        }
+
+        // returns last tick at or before frame
+        int64_t frameToTick(int64_t frame) const {
+            auto it = std::upper_bound(tempos.begin(), tempos.end(), (double)frame,
+                [](double f, const tempoChange& c){ return f < c.frame; });
+            const tempoChange& c = (it == tempos.begin()) ? tempos.front() : *(it-1);
+            return c.tick + (int64_t)std::floor((frame - c.frame) / framesPerTick(c.bpm));
+        }
+
+        // returns tick at start of bar (+ beats in that bar's beat unit)
+        int64_t barToTick(int64_t bar, int beat=0) const {
+            const signatureChange& s = signatureAt(bar);
+            return s.tick + (bar - s.bar) * barTicks(s.timeSig) + beat * beatTicks(s.timeSig);
+        }
+
+        // returns length of note type in ticks
+        int64_t duration(Tempo::note_type type, bool dot=false) const {
+            int64_t ticks = (int64_t)(note_length[type] * ppq);
+            if(dot) ticks += ticks/2;
+            return ticks;
+        }
+
+        // returns fixed Tempo at tick, for Tempo::duration in seconds
+        Tempo tempoAt(int64_t tick) const {
+            const tempoChange& c = tempos[tempoIndex(tick)];
+            const signatureChange& s = *(std::upper_bound(signatures.begin(), signatures.end(), tick,
+                [](int64_t t, const signatureChange& c){ return t < c.tick; }) - 1);
+            return Tempo(c.bpm, s.timeSig.top, s.timeSig.bottom);
+        }
+
+        double sampleRate;
+        int ppq;
+        std::vector<tempoChange> tempos;
+        std::vector<signatureChange> signatures;
+
+    private:
+        size_t cursor = 0;
+
+        double framesPerTick(float bpm) const {
+            return sampleRate * 60.0 / (bpm * (double)ppq);
+        }
+
+        int64_t beatTicks(Tempo::timeSignature sig) const {
+            return (int64_t)ppq * 4 / sig.bottom;
+        }
+
+        int64_t barTicks(Tempo::timeSignature sig) const {
+            return beatTicks(sig) * sig.top;
+        }
+
+        // index of the tempo change in effect at tick
+        size_t tempoIndex(int64_t tick) const {
+            auto it = std::upper_bound(tempos.begin(), tempos.end(), tick,
+                [](int64_t t, const tempoChange& c){ return t < c.tick; });
+            return (it == tempos.begin()) ? 0 : (it - tempos.begin()) - 1;
+        }
+
+        int64_t frameIn(size_t index, int64_t tick) const {
+            const tempoChange& c = tempos[index];
+            return (int64_t)std::llround(c.frame + (tick - c.tick) * framesPerTick(c.bpm));
+        }
+
+        const signatureChange& signatureAt(int64_t bar) const {
+            auto it = std::upper_bound(signatures.begin(), signatures.end(), bar,
+                [](int64_t b, const signatureChange& c){ return b < c.bar; });
+            return (it == signatures.begin()) ? signatures.front() : *(it-1);
+        }
+};